@@ -0,0 +1,41 @@
+#include "Debouncer.h"
+
+#include "mbed_events.h"
+
+
+Debouncer::Debouncer(EventQueue *q, int ms, mbed::Callback<void()> f)
+    : _equeue(&q->_equeue), _ms(ms), _f(f), _id(0) {
+    _event = static_cast<Debouncer**>(
+            equeue_alloc(_equeue, sizeof(Debouncer*)));
+    if (_event) {
+        *_event = this;
+    }
+}
+
+Debouncer::~Debouncer() {
+    if (_event) {
+        equeue_release(_equeue, _event);
+    }
+}
+
+int Debouncer::trigger() {
+    if (!_event) {
+        return 0;
+    }
+
+    _id = equeue_repost(_equeue, &Debouncer::dispatch, _event, _ms);
+    return _id;
+}
+
+void Debouncer::cancel() {
+    equeue_cancel(_equeue, _id);
+}
+
+bool Debouncer::pending() {
+    return equeue_pending(_equeue, _id);
+}
+
+void Debouncer::dispatch(void *p) {
+    Debouncer *d = *static_cast<Debouncer**>(p);
+    d->_f();
+}
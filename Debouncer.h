@@ -0,0 +1,93 @@
+/* events
+ * Copyright (c) 2006-2013 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef DEBOUNCER_H
+#define DEBOUNCER_H
+
+#include "EventQueue.h"
+
+namespace events {
+
+/** Debouncer
+ *
+ *  Calls a function on an event queue once input has gone quiet
+ *
+ *  Each trigger pushes back a single preallocated event, so the function
+ *  runs once the specified milliseconds have passed without a trigger.
+ *  Triggering does not allocate memory, and moves the event in place
+ *  rather than cancelling and posting a new event.
+ */
+class Debouncer {
+public:
+    /** Create a debouncer
+     *
+     *  Allocates the debouncer's event from the event queue. If there is
+     *  not enough memory, every trigger returns an id of 0.
+     *
+     *  @param q        Event queue to dispatch on
+     *  @param ms       Quiet period in milliseconds
+     *  @param f        Function to execute once input goes quiet
+     */
+    Debouncer(EventQueue *q, int ms, mbed::Callback<void()> f);
+
+    /** Destroy a debouncer
+     *
+     *  Cancels any pending call and frees the debouncer's event. If the
+     *  function is executing, the event is freed once it returns, so the
+     *  debouncer may be destroyed from within its own function.
+     */
+    ~Debouncer();
+
+    /** Trigger the debouncer
+     *
+     *  Schedules the function to execute after the quiet period, pushing
+     *  back any pending call.
+     *
+     *  The trigger function is irq safe.
+     *
+     *  @return         A unique id that represents the pending call, or 0
+     *                  if the debouncer's event could not be allocated
+     */
+    int trigger();
+
+    /** Cancel a pending call
+     *
+     *  The cancel function is irq safe.
+     */
+    void cancel();
+
+    /** Check for a pending call
+     *
+     *  @return         True if the function is scheduled and has not
+     *                  started executing
+     */
+    bool pending();
+
+private:
+    Debouncer(const Debouncer &);
+    Debouncer &operator=(const Debouncer &);
+
+    static void dispatch(void *p);
+
+    equeue_t *_equeue;
+    int _ms;
+    mbed::Callback<void()> _f;
+    Debouncer **_event;
+    int _id;
+};
+
+}
+
+#endif
@@ -55,7 +55,7 @@ public:
                     static void dtor(void *p) { static_cast<C*>(p)->~C(); }
                 };
 
-                void *p = equeue_alloc(e->equeue, sizeof(C));
+                void *p = equeue_alloc_expire(e->equeue, sizeof(C), e->expire);
                 if (!p) {
                     return 0;
                 }
@@ -64,6 +64,11 @@ public:
                 equeue_event_delay(p, e->delay);
                 equeue_event_period(p, e->period);
                 equeue_event_dtor(p, &local::dtor);
+                if (e->coalesce) {
+                    return equeue_post_unique(e->equeue, &e->id,
+                            &local::call, p);
+                }
+
                 return equeue_post(e->equeue, &local::call, p);
             }
 
@@ -79,6 +84,8 @@ public:
             _event->id = 0;
             _event->delay = 0;
             _event->period = -1;
+            _event->expire = -1;
+            _event->coalesce = false;
 
             _event->post = &local::post;
             _event->dtor = &local::dtor;
@@ -142,6 +149,36 @@ public:
         }
     }
 
+    /** Configure the expiry of an event
+     *
+     *  If the event is dispatched more than the specified number of
+     *  milliseconds after its target time, it is dropped without calling
+     *  the callback. A negative value disables expiry, which is the default.
+     *
+     *  @param expire   Millisecond window after the event's target time in
+     *                  which the event is still dispatched
+     */
+    void expire(int expire) {
+        if (_event) {
+            _event->expire = expire;
+        }
+    }
+
+    /** Configure the event to coalesce posts
+     *
+     *  If enabled, posting the event while a previous post is still
+     *  pending does not post a new event, and instead returns the id of
+     *  the pending event. The pending event keeps the arguments it was
+     *  posted with. Coalesced posts do not allocate memory.
+     *
+     *  @param coalesce True to coalesce posts while pending
+     */
+    void coalesce(bool coalesce = true) {
+        if (_event) {
+            _event->coalesce = coalesce;
+        }
+    }
+
     /** Posts an event onto the underlying event queue
      *
      *  The event is posted to the underlying queue and is executed in the
@@ -160,6 +197,11 @@ public:
             return 0;
         }
 
+        if (_event->coalesce &&
+                equeue_pending(_event->equeue, _event->id)) {
+            return _event->id;
+        }
+
         _event->id = _event->post(_event);
         return _event->id;
     }
@@ -215,6 +257,8 @@ private:
 
         int delay;
         int period;
+        int expire;
+        bool coalesce;
 
         int (*post)(struct event *);
         void (*dtor)(struct event *);
@@ -451,7 +495,7 @@ public:
                     static void dtor(void *p) { static_cast<C*>(p)->~C(); }
                 };
 
-                void *p = equeue_alloc(e->equeue, sizeof(C));
+                void *p = equeue_alloc_expire(e->equeue, sizeof(C), e->expire);
                 if (!p) {
                     return 0;
                 }
@@ -460,6 +504,11 @@ public:
                 equeue_event_delay(p, e->delay);
                 equeue_event_period(p, e->period);
                 equeue_event_dtor(p, &local::dtor);
+                if (e->coalesce) {
+                    return equeue_post_unique(e->equeue, &e->id,
+                            &local::call, p);
+                }
+
                 return equeue_post(e->equeue, &local::call, p);
             }
 
@@ -475,6 +524,8 @@ public:
             _event->id = 0;
             _event->delay = 0;
             _event->period = -1;
+            _event->expire = -1;
+            _event->coalesce = false;
 
             _event->post = &local::post;
             _event->dtor = &local::dtor;
@@ -538,6 +589,36 @@ public:
         }
     }
 
+    /** Configure the expiry of an event
+     *
+     *  If the event is dispatched more than the specified number of
+     *  milliseconds after its target time, it is dropped without calling
+     *  the callback. A negative value disables expiry, which is the default.
+     *
+     *  @param expire   Millisecond window after the event's target time in
+     *                  which the event is still dispatched
+     */
+    void expire(int expire) {
+        if (_event) {
+            _event->expire = expire;
+        }
+    }
+
+    /** Configure the event to coalesce posts
+     *
+     *  If enabled, posting the event while a previous post is still
+     *  pending does not post a new event, and instead returns the id of
+     *  the pending event. The pending event keeps the arguments it was
+     *  posted with. Coalesced posts do not allocate memory.
+     *
+     *  @param coalesce True to coalesce posts while pending
+     */
+    void coalesce(bool coalesce = true) {
+        if (_event) {
+            _event->coalesce = coalesce;
+        }
+    }
+
     /** Posts an event onto the underlying event queue
      *
      *  The event is posted to the underlying queue and is executed in the
@@ -556,6 +637,11 @@ public:
             return 0;
         }
 
+        if (_event->coalesce &&
+                equeue_pending(_event->equeue, _event->id)) {
+            return _event->id;
+        }
+
         _event->id = _event->post(_event, a0);
         return _event->id;
     }
@@ -611,6 +697,8 @@ private:
 
         int delay;
         int period;
+        int expire;
+        bool coalesce;
 
         int (*post)(struct event *, A0 a0);
         void (*dtor)(struct event *);
@@ -847,7 +935,7 @@ public:
                     static void dtor(void *p) { static_cast<C*>(p)->~C(); }
                 };
 
-                void *p = equeue_alloc(e->equeue, sizeof(C));
+                void *p = equeue_alloc_expire(e->equeue, sizeof(C), e->expire);
                 if (!p) {
                     return 0;
                 }
@@ -856,6 +944,11 @@ public:
                 equeue_event_delay(p, e->delay);
                 equeue_event_period(p, e->period);
                 equeue_event_dtor(p, &local::dtor);
+                if (e->coalesce) {
+                    return equeue_post_unique(e->equeue, &e->id,
+                            &local::call, p);
+                }
+
                 return equeue_post(e->equeue, &local::call, p);
             }
 
@@ -871,6 +964,8 @@ public:
             _event->id = 0;
             _event->delay = 0;
             _event->period = -1;
+            _event->expire = -1;
+            _event->coalesce = false;
 
             _event->post = &local::post;
             _event->dtor = &local::dtor;
@@ -934,6 +1029,36 @@ public:
         }
     }
 
+    /** Configure the expiry of an event
+     *
+     *  If the event is dispatched more than the specified number of
+     *  milliseconds after its target time, it is dropped without calling
+     *  the callback. A negative value disables expiry, which is the default.
+     *
+     *  @param expire   Millisecond window after the event's target time in
+     *                  which the event is still dispatched
+     */
+    void expire(int expire) {
+        if (_event) {
+            _event->expire = expire;
+        }
+    }
+
+    /** Configure the event to coalesce posts
+     *
+     *  If enabled, posting the event while a previous post is still
+     *  pending does not post a new event, and instead returns the id of
+     *  the pending event. The pending event keeps the arguments it was
+     *  posted with. Coalesced posts do not allocate memory.
+     *
+     *  @param coalesce True to coalesce posts while pending
+     */
+    void coalesce(bool coalesce = true) {
+        if (_event) {
+            _event->coalesce = coalesce;
+        }
+    }
+
     /** Posts an event onto the underlying event queue
      *
      *  The event is posted to the underlying queue and is executed in the
@@ -952,6 +1077,11 @@ public:
             return 0;
         }
 
+        if (_event->coalesce &&
+                equeue_pending(_event->equeue, _event->id)) {
+            return _event->id;
+        }
+
         _event->id = _event->post(_event, a0, a1);
         return _event->id;
     }
@@ -1007,6 +1137,8 @@ private:
 
         int delay;
         int period;
+        int expire;
+        bool coalesce;
 
         int (*post)(struct event *, A0 a0, A1 a1);
         void (*dtor)(struct event *);
@@ -1243,7 +1375,7 @@ public:
                     static void dtor(void *p) { static_cast<C*>(p)->~C(); }
                 };
 
-                void *p = equeue_alloc(e->equeue, sizeof(C));
+                void *p = equeue_alloc_expire(e->equeue, sizeof(C), e->expire);
                 if (!p) {
                     return 0;
                 }
@@ -1252,6 +1384,11 @@ public:
                 equeue_event_delay(p, e->delay);
                 equeue_event_period(p, e->period);
                 equeue_event_dtor(p, &local::dtor);
+                if (e->coalesce) {
+                    return equeue_post_unique(e->equeue, &e->id,
+                            &local::call, p);
+                }
+
                 return equeue_post(e->equeue, &local::call, p);
             }
 
@@ -1267,6 +1404,8 @@ public:
             _event->id = 0;
             _event->delay = 0;
             _event->period = -1;
+            _event->expire = -1;
+            _event->coalesce = false;
 
             _event->post = &local::post;
             _event->dtor = &local::dtor;
@@ -1330,6 +1469,36 @@ public:
         }
     }
 
+    /** Configure the expiry of an event
+     *
+     *  If the event is dispatched more than the specified number of
+     *  milliseconds after its target time, it is dropped without calling
+     *  the callback. A negative value disables expiry, which is the default.
+     *
+     *  @param expire   Millisecond window after the event's target time in
+     *                  which the event is still dispatched
+     */
+    void expire(int expire) {
+        if (_event) {
+            _event->expire = expire;
+        }
+    }
+
+    /** Configure the event to coalesce posts
+     *
+     *  If enabled, posting the event while a previous post is still
+     *  pending does not post a new event, and instead returns the id of
+     *  the pending event. The pending event keeps the arguments it was
+     *  posted with. Coalesced posts do not allocate memory.
+     *
+     *  @param coalesce True to coalesce posts while pending
+     */
+    void coalesce(bool coalesce = true) {
+        if (_event) {
+            _event->coalesce = coalesce;
+        }
+    }
+
     /** Posts an event onto the underlying event queue
      *
      *  The event is posted to the underlying queue and is executed in the
@@ -1348,6 +1517,11 @@ public:
             return 0;
         }
 
+        if (_event->coalesce &&
+                equeue_pending(_event->equeue, _event->id)) {
+            return _event->id;
+        }
+
         _event->id = _event->post(_event, a0, a1, a2);
         return _event->id;
     }
@@ -1403,6 +1577,8 @@ private:
 
         int delay;
         int period;
+        int expire;
+        bool coalesce;
 
         int (*post)(struct event *, A0 a0, A1 a1, A2 a2);
         void (*dtor)(struct event *);
@@ -1639,7 +1815,7 @@ public:
                     static void dtor(void *p) { static_cast<C*>(p)->~C(); }
                 };
 
-                void *p = equeue_alloc(e->equeue, sizeof(C));
+                void *p = equeue_alloc_expire(e->equeue, sizeof(C), e->expire);
                 if (!p) {
                     return 0;
                 }
@@ -1648,6 +1824,11 @@ public:
                 equeue_event_delay(p, e->delay);
                 equeue_event_period(p, e->period);
                 equeue_event_dtor(p, &local::dtor);
+                if (e->coalesce) {
+                    return equeue_post_unique(e->equeue, &e->id,
+                            &local::call, p);
+                }
+
                 return equeue_post(e->equeue, &local::call, p);
             }
 
@@ -1663,6 +1844,8 @@ public:
             _event->id = 0;
             _event->delay = 0;
             _event->period = -1;
+            _event->expire = -1;
+            _event->coalesce = false;
 
             _event->post = &local::post;
             _event->dtor = &local::dtor;
@@ -1726,6 +1909,36 @@ public:
         }
     }
 
+    /** Configure the expiry of an event
+     *
+     *  If the event is dispatched more than the specified number of
+     *  milliseconds after its target time, it is dropped without calling
+     *  the callback. A negative value disables expiry, which is the default.
+     *
+     *  @param expire   Millisecond window after the event's target time in
+     *                  which the event is still dispatched
+     */
+    void expire(int expire) {
+        if (_event) {
+            _event->expire = expire;
+        }
+    }
+
+    /** Configure the event to coalesce posts
+     *
+     *  If enabled, posting the event while a previous post is still
+     *  pending does not post a new event, and instead returns the id of
+     *  the pending event. The pending event keeps the arguments it was
+     *  posted with. Coalesced posts do not allocate memory.
+     *
+     *  @param coalesce True to coalesce posts while pending
+     */
+    void coalesce(bool coalesce = true) {
+        if (_event) {
+            _event->coalesce = coalesce;
+        }
+    }
+
     /** Posts an event onto the underlying event queue
      *
      *  The event is posted to the underlying queue and is executed in the
@@ -1744,6 +1957,11 @@ public:
             return 0;
         }
 
+        if (_event->coalesce &&
+                equeue_pending(_event->equeue, _event->id)) {
+            return _event->id;
+        }
+
         _event->id = _event->post(_event, a0, a1, a2, a3);
         return _event->id;
     }
@@ -1799,6 +2017,8 @@ private:
 
         int delay;
         int period;
+        int expire;
+        bool coalesce;
 
         int (*post)(struct event *, A0 a0, A1 a1, A2 a2, A3 a3);
         void (*dtor)(struct event *);
@@ -2035,7 +2255,7 @@ public:
                     static void dtor(void *p) { static_cast<C*>(p)->~C(); }
                 };
 
-                void *p = equeue_alloc(e->equeue, sizeof(C));
+                void *p = equeue_alloc_expire(e->equeue, sizeof(C), e->expire);
                 if (!p) {
                     return 0;
                 }
@@ -2044,6 +2264,11 @@ public:
                 equeue_event_delay(p, e->delay);
                 equeue_event_period(p, e->period);
                 equeue_event_dtor(p, &local::dtor);
+                if (e->coalesce) {
+                    return equeue_post_unique(e->equeue, &e->id,
+                            &local::call, p);
+                }
+
                 return equeue_post(e->equeue, &local::call, p);
             }
 
@@ -2059,6 +2284,8 @@ public:
             _event->id = 0;
             _event->delay = 0;
             _event->period = -1;
+            _event->expire = -1;
+            _event->coalesce = false;
 
             _event->post = &local::post;
             _event->dtor = &local::dtor;
@@ -2122,6 +2349,36 @@ public:
         }
     }
 
+    /** Configure the expiry of an event
+     *
+     *  If the event is dispatched more than the specified number of
+     *  milliseconds after its target time, it is dropped without calling
+     *  the callback. A negative value disables expiry, which is the default.
+     *
+     *  @param expire   Millisecond window after the event's target time in
+     *                  which the event is still dispatched
+     */
+    void expire(int expire) {
+        if (_event) {
+            _event->expire = expire;
+        }
+    }
+
+    /** Configure the event to coalesce posts
+     *
+     *  If enabled, posting the event while a previous post is still
+     *  pending does not post a new event, and instead returns the id of
+     *  the pending event. The pending event keeps the arguments it was
+     *  posted with. Coalesced posts do not allocate memory.
+     *
+     *  @param coalesce True to coalesce posts while pending
+     */
+    void coalesce(bool coalesce = true) {
+        if (_event) {
+            _event->coalesce = coalesce;
+        }
+    }
+
     /** Posts an event onto the underlying event queue
      *
      *  The event is posted to the underlying queue and is executed in the
@@ -2140,6 +2397,11 @@ public:
             return 0;
         }
 
+        if (_event->coalesce &&
+                equeue_pending(_event->equeue, _event->id)) {
+            return _event->id;
+        }
+
         _event->id = _event->post(_event, a0, a1, a2, a3, a4);
         return _event->id;
     }
@@ -2195,6 +2457,8 @@ private:
 
         int delay;
         int period;
+        int expire;
+        bool coalesce;
 
         int (*post)(struct event *, A0 a0, A1 a1, A2 a2, A3 a3, A4 a4);
         void (*dtor)(struct event *);
@@ -1,7 +1,6 @@
 #include "EventQueue.h"
 
 #include "mbed_events.h"
-#include "mbed.h"
 
 
 EventQueue::EventQueue(unsigned event_size, unsigned char *event_pointer) {
@@ -25,18 +24,18 @@ void EventQueue::break_dispatch() {
 }
 
 unsigned EventQueue::tick() {
-    return equeue_tick();
+    return equeue_now(&_equeue);
 }
 
 void EventQueue::cancel(int id) {
     return equeue_cancel(&_equeue, id);
 }
 
-void EventQueue::background(Callback<void(int)> update) {
+void EventQueue::background(mbed::Callback<void(int)> update) {
     _update = update;
 
     if (_update) {
-        equeue_background(&_equeue, &Callback<void(int)>::thunk, &_update);
+        equeue_background(&_equeue, &mbed::Callback<void(int)>::thunk, &_update);
     } else {
         equeue_background(&_equeue, 0, 0);
     }
@@ -49,3 +48,22 @@ void EventQueue::chain(EventQueue *target) {
         equeue_chain(&_equeue, 0);
     }
 }
+
+void EventQueue::stats(struct equeue_stats *stats) {
+    return equeue_stats(&_equeue, stats);
+}
+
+unsigned EventQueue::mem_info(struct equeue_mem_info *info,
+        struct equeue_mem_chunk *chunks, unsigned count) {
+    return equeue_mem_info(&_equeue, info, chunks, count);
+}
+
+void EventQueue::alert(size_t highwater,
+        void (*alert)(void *data, const struct equeue_alert_info *info),
+        void *data) {
+    equeue_alert(&_equeue, highwater, alert, data);
+}
+
+unsigned EventQueue::snapshot(struct equeue_snapshot *events, unsigned count) {
+    return equeue_snapshot(&_equeue, events, count);
+}
@@ -39,6 +39,8 @@ namespace events {
 // Predeclared classes
 template <typename F>
 class Event;
+class Debouncer;
+class Throttler;
 
 
 /** EventQueue
@@ -156,6 +158,65 @@ public:
      */
     void chain(EventQueue *target);
 
+    /** Query runtime statistics of the event queue
+     *
+     *  Fills out the provided equeue_stats with the number of events
+     *  posted, dispatched and cancelled, allocation failures, current and
+     *  peak pending events, dispatch passes, and the state of the event
+     *  queue's memory.
+     *
+     *  The counters are always maintained, so querying them is cheap
+     *  enough to use in production.
+     *
+     *  @param stats    Structure to fill with the event queue's statistics
+     */
+    void stats(struct equeue_stats *stats);
+
+    /** Inspect the memory of the event queue
+     *
+     *  Fills out the provided equeue_mem_info with the remaining slab,
+     *  freed events available for reuse, fragmentation, and a histogram
+     *  of requested allocation sizes. This tells whether a call that
+     *  returned 0 ran into a full or a fragmented queue.
+     *
+     *  @param info     Structure to fill with the event queue's memory state
+     *  @param chunks   Optional array to fill with the sizes of freed events
+     *                  and the number of freed events of each size
+     *  @param count    Number of entries in chunks
+     *  @return         Number of entries written to chunks
+     */
+    unsigned mem_info(struct equeue_mem_info *info,
+            struct equeue_mem_chunk *chunks = 0, unsigned count = 0);
+
+    /** Alert on allocation failures and high memory usage
+     *
+     *  The alert function is called when an allocation fails, and when
+     *  the memory used by events first reaches the high-water mark, with
+     *  the requested size and a breakdown of the event queue's memory.
+     *  The alert function may be called from interrupt context.
+     *
+     *  @param highwater    Bytes in use that trigger an alert, or 0 to
+     *                      only alert on allocation failures
+     *  @param alert        Function to call on alerts, or null to disable
+     *  @param data         Argument to pass to the alert function
+     */
+    void alert(size_t highwater,
+            void (*alert)(void *data, const struct equeue_alert_info *info),
+            void *data);
+
+    /** Take a snapshot of the pending events
+     *
+     *  Copies the id, target tick, period, callback and size of pending
+     *  events in the order they will be dispatched. The event queue is
+     *  only locked for a small number of events at a time, so the
+     *  snapshot does not stall callers posting events.
+     *
+     *  @param events   Array to fill with the pending events
+     *  @param count    Number of entries in events
+     *  @return         Number of entries written to events
+     */
+    unsigned snapshot(struct equeue_snapshot *events, unsigned count);
+
     /** Calls an event on the queue
      *
      *  The specified callback will be executed in the context of the event
@@ -184,6 +245,7 @@ public:
 
         F *e = new (p) F(f);
         equeue_event_dtor(e, &local::dtor);
+        wrapped(e, e);
         return equeue_post(&_equeue, &local::call, e);
     }
 
@@ -419,6 +481,277 @@ public:
         return call(mbed::Callback<void(A0, A1, A2, A3, A4)>(obj, method), a0, a1, a2, a3, a4);
     }
 
+    /** Calls an event on the queue, waiting for memory if necessary
+     *
+     *  The specified callback will be executed in the context of the event
+     *  queue's dispatch loop.
+     *
+     *  If there is not enough memory to allocate the event, call_wait
+     *  blocks until memory is freed by the dispatch loop, for up to the
+     *  specified timeout. This provides backpressure between producers and
+     *  a slower dispatch loop.
+     *
+     *  The call_wait function is not irq safe and must not be called from
+     *  the context of the dispatch loop, use call instead.
+     *
+     *  @param ms       Time to wait for memory in milliseconds, or a negative
+     *                  value to wait indefinitely
+     *  @param f        Function to execute in the context of the dispatch loop
+     *  @param a0..a4   Arguments to pass to the callback
+     *  @return         A unique id that represents the posted event and can
+     *                  be passed to cancel, or an id of 0 if memory could not
+     *                  be allocated before the timeout.
+     */
+    template <typename F>
+    int call_wait(int ms, F f) {
+        struct local {
+            static void call(void *p) { (*static_cast<F*>(p))(); }
+            static void dtor(void *p) { static_cast<F*>(p)->~F(); }
+        };
+
+        void *p = equeue_alloc_wait(&_equeue, sizeof(F), ms);
+        if (!p) {
+            return 0;
+        }
+
+        F *e = new (p) F(f);
+        equeue_event_dtor(e, &local::dtor);
+        wrapped(e, e);
+        return equeue_post(&_equeue, &local::call, e);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename F, typename A0>
+    int call_wait(int ms, F f, A0 a0) {
+        return call_wait(ms, context10<F, A0>(f, a0));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename F, typename A0, typename A1>
+    int call_wait(int ms, F f, A0 a0, A1 a1) {
+        return call_wait(ms, context20<F, A0, A1>(f, a0, a1));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename F, typename A0, typename A1, typename A2>
+    int call_wait(int ms, F f, A0 a0, A1 a1, A2 a2) {
+        return call_wait(ms, context30<F, A0, A1, A2>(f, a0, a1, a2));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename F, typename A0, typename A1, typename A2, typename A3>
+    int call_wait(int ms, F f, A0 a0, A1 a1, A2 a2, A3 a3) {
+        return call_wait(ms, context40<F, A0, A1, A2, A3>(f, a0, a1, a2, a3));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename F, typename A0, typename A1, typename A2, typename A3, typename A4>
+    int call_wait(int ms, F f, A0 a0, A1 a1, A2 a2, A3 a3, A4 a4) {
+        return call_wait(ms, context50<F, A0, A1, A2, A3, A4>(f, a0, a1, a2, a3, a4));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R>
+    int call_wait(int ms, T *obj, R (T::*method)()) {
+        return call_wait(ms, mbed::Callback<void()>(obj, method));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R>
+    int call_wait(int ms, const T *obj, R (T::*method)() const) {
+        return call_wait(ms, mbed::Callback<void()>(obj, method));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R>
+    int call_wait(int ms, volatile T *obj, R (T::*method)() volatile) {
+        return call_wait(ms, mbed::Callback<void()>(obj, method));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R>
+    int call_wait(int ms, const volatile T *obj, R (T::*method)() const volatile) {
+        return call_wait(ms, mbed::Callback<void()>(obj, method));
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0>
+    int call_wait(int ms, T *obj, R (T::*method)(A0), A0 a0) {
+        return call_wait(ms, mbed::Callback<void(A0)>(obj, method), a0);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0>
+    int call_wait(int ms, const T *obj, R (T::*method)(A0) const, A0 a0) {
+        return call_wait(ms, mbed::Callback<void(A0)>(obj, method), a0);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0>
+    int call_wait(int ms, volatile T *obj, R (T::*method)(A0) volatile, A0 a0) {
+        return call_wait(ms, mbed::Callback<void(A0)>(obj, method), a0);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0>
+    int call_wait(int ms, const volatile T *obj, R (T::*method)(A0) const volatile, A0 a0) {
+        return call_wait(ms, mbed::Callback<void(A0)>(obj, method), a0);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1>
+    int call_wait(int ms, T *obj, R (T::*method)(A0, A1), A0 a0, A1 a1) {
+        return call_wait(ms, mbed::Callback<void(A0, A1)>(obj, method), a0, a1);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1>
+    int call_wait(int ms, const T *obj, R (T::*method)(A0, A1) const, A0 a0, A1 a1) {
+        return call_wait(ms, mbed::Callback<void(A0, A1)>(obj, method), a0, a1);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1>
+    int call_wait(int ms, volatile T *obj, R (T::*method)(A0, A1) volatile, A0 a0, A1 a1) {
+        return call_wait(ms, mbed::Callback<void(A0, A1)>(obj, method), a0, a1);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1>
+    int call_wait(int ms, const volatile T *obj, R (T::*method)(A0, A1) const volatile, A0 a0, A1 a1) {
+        return call_wait(ms, mbed::Callback<void(A0, A1)>(obj, method), a0, a1);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2>
+    int call_wait(int ms, T *obj, R (T::*method)(A0, A1, A2), A0 a0, A1 a1, A2 a2) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2)>(obj, method), a0, a1, a2);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2>
+    int call_wait(int ms, const T *obj, R (T::*method)(A0, A1, A2) const, A0 a0, A1 a1, A2 a2) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2)>(obj, method), a0, a1, a2);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2>
+    int call_wait(int ms, volatile T *obj, R (T::*method)(A0, A1, A2) volatile, A0 a0, A1 a1, A2 a2) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2)>(obj, method), a0, a1, a2);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2>
+    int call_wait(int ms, const volatile T *obj, R (T::*method)(A0, A1, A2) const volatile, A0 a0, A1 a1, A2 a2) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2)>(obj, method), a0, a1, a2);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2, typename A3>
+    int call_wait(int ms, T *obj, R (T::*method)(A0, A1, A2, A3), A0 a0, A1 a1, A2 a2, A3 a3) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2, A3)>(obj, method), a0, a1, a2, a3);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2, typename A3>
+    int call_wait(int ms, const T *obj, R (T::*method)(A0, A1, A2, A3) const, A0 a0, A1 a1, A2 a2, A3 a3) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2, A3)>(obj, method), a0, a1, a2, a3);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2, typename A3>
+    int call_wait(int ms, volatile T *obj, R (T::*method)(A0, A1, A2, A3) volatile, A0 a0, A1 a1, A2 a2, A3 a3) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2, A3)>(obj, method), a0, a1, a2, a3);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2, typename A3>
+    int call_wait(int ms, const volatile T *obj, R (T::*method)(A0, A1, A2, A3) const volatile, A0 a0, A1 a1, A2 a2, A3 a3) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2, A3)>(obj, method), a0, a1, a2, a3);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2, typename A3, typename A4>
+    int call_wait(int ms, T *obj, R (T::*method)(A0, A1, A2, A3, A4), A0 a0, A1 a1, A2 a2, A3 a3, A4 a4) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2, A3, A4)>(obj, method), a0, a1, a2, a3, a4);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2, typename A3, typename A4>
+    int call_wait(int ms, const T *obj, R (T::*method)(A0, A1, A2, A3, A4) const, A0 a0, A1 a1, A2 a2, A3 a3, A4 a4) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2, A3, A4)>(obj, method), a0, a1, a2, a3, a4);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2, typename A3, typename A4>
+    int call_wait(int ms, volatile T *obj, R (T::*method)(A0, A1, A2, A3, A4) volatile, A0 a0, A1 a1, A2 a2, A3 a3, A4 a4) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2, A3, A4)>(obj, method), a0, a1, a2, a3, a4);
+    }
+
+    /** Calls an event on the queue, waiting for memory if necessary
+     *  @see EventQueue::call_wait
+     */
+    template <typename T, typename R, typename A0, typename A1, typename A2, typename A3, typename A4>
+    int call_wait(int ms, const volatile T *obj, R (T::*method)(A0, A1, A2, A3, A4) const volatile, A0 a0, A1 a1, A2 a2, A3 a3, A4 a4) {
+        return call_wait(ms, mbed::Callback<void(A0, A1, A2, A3, A4)>(obj, method), a0, a1, a2, a3, a4);
+    }
+
     /** Calls an event on the queue after a specified delay
      *
      *  The specified callback will be executed in the context of the event
@@ -449,6 +782,7 @@ public:
         F *e = new (p) F(f);
         equeue_event_delay(e, ms);
         equeue_event_dtor(e, &local::dtor);
+        wrapped(e, e);
         return equeue_post(&_equeue, &local::call, e);
     }
 
@@ -715,6 +1049,7 @@ public:
         equeue_event_delay(e, ms);
         equeue_event_period(e, ms);
         equeue_event_dtor(e, &local::dtor);
+        wrapped(e, e);
         return equeue_post(&_equeue, &local::call, e);
     }
 
@@ -2040,6 +2375,8 @@ public:
 protected:
     template <typename F>
     friend class Event;
+    friend class Debouncer;
+    friend class Throttler;
     struct equeue _equeue;
     mbed::Callback<void(int)> _update;
 
@@ -2474,6 +2811,72 @@ protected:
             f(c0, c1, c2, c3, c4, a0, a1, a2, a3, a4);
         }
     };
+
+    // Events that start with a function pointer are marked as wrapped, so
+    // hooks such as the profiler attribute them to that function rather
+    // than to the shared thunk for their type
+    template <typename F>
+    static void wrapped(void *p, const F *f) {}
+
+    template <typename R>
+    static void wrapped(void *p, R (*const *f)()) {
+        equeue_event_wrapped(p);
+    }
+
+    template <typename R, typename B0>
+    static void wrapped(void *p, R (*const *f)(B0)) {
+        equeue_event_wrapped(p);
+    }
+
+    template <typename R, typename B0, typename B1>
+    static void wrapped(void *p, R (*const *f)(B0, B1)) {
+        equeue_event_wrapped(p);
+    }
+
+    template <typename R, typename B0, typename B1, typename B2>
+    static void wrapped(void *p, R (*const *f)(B0, B1, B2)) {
+        equeue_event_wrapped(p);
+    }
+
+    template <typename R, typename B0, typename B1, typename B2, typename B3>
+    static void wrapped(void *p, R (*const *f)(B0, B1, B2, B3)) {
+        equeue_event_wrapped(p);
+    }
+
+    template <typename R, typename B0, typename B1, typename B2, typename B3, typename B4>
+    static void wrapped(void *p, R (*const *f)(B0, B1, B2, B3, B4)) {
+        equeue_event_wrapped(p);
+    }
+
+    template <typename F>
+    static void wrapped(void *p, const context00<F> *c) {
+        wrapped(p, &c->f);
+    }
+
+    template <typename F, typename C0>
+    static void wrapped(void *p, const context10<F, C0> *c) {
+        wrapped(p, &c->f);
+    }
+
+    template <typename F, typename C0, typename C1>
+    static void wrapped(void *p, const context20<F, C0, C1> *c) {
+        wrapped(p, &c->f);
+    }
+
+    template <typename F, typename C0, typename C1, typename C2>
+    static void wrapped(void *p, const context30<F, C0, C1, C2> *c) {
+        wrapped(p, &c->f);
+    }
+
+    template <typename F, typename C0, typename C1, typename C2, typename C3>
+    static void wrapped(void *p, const context40<F, C0, C1, C2, C3> *c) {
+        wrapped(p, &c->f);
+    }
+
+    template <typename F, typename C0, typename C1, typename C2, typename C3, typename C4>
+    static void wrapped(void *p, const context50<F, C0, C1, C2, C3, C4> *c) {
+        wrapped(p, &c->f);
+    }
 };
 
 }
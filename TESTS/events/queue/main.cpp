@@ -232,6 +232,137 @@ void event_inference_test() {
     TEST_ASSERT_EQUAL(counter, 30);
 }
 
+void event_coalesce_test() {
+    counter = 0;
+    EventQueue queue(2048);
+
+    Event<void()> e = queue.event(count1, 1);
+    e.coalesce();
+
+    int id = e.post();
+    TEST_ASSERT_NOT_EQUAL(0, id);
+
+    struct equeue_stats before;
+    queue.stats(&before);
+
+    // posting again while pending hands back the pending id
+    TEST_ASSERT_EQUAL(id, e.post());
+
+    struct equeue_stats after;
+    queue.stats(&after);
+    TEST_ASSERT_EQUAL(before.posted, after.posted);
+    TEST_ASSERT_EQUAL(1, after.pending);
+    TEST_ASSERT_EQUAL(before.slab_used - before.free_bytes,
+            after.slab_used - after.free_bytes);
+
+    queue.dispatch(0);
+    TEST_ASSERT_EQUAL(1, counter);
+}
+
+// Testing the debouncer and throttler
+void increment() {
+    counter += 1;
+}
+
+size_t used_bytes(EventQueue *queue) {
+    struct equeue_stats stats;
+    queue->stats(&stats);
+    return stats.slab_used - stats.free_bytes;
+}
+
+void debouncer_test() {
+    counter = 0;
+    EventQueue queue(2048);
+    size_t used = used_bytes(&queue);
+
+    {
+        Debouncer debouncer(&queue, 100, increment);
+
+        // triggers within the quiet period push the call back
+        for (int i = 0; i < 5; i++) {
+            TEST_ASSERT_NOT_EQUAL(0, debouncer.trigger());
+            queue.dispatch(20);
+        }
+        TEST_ASSERT_EQUAL(0, counter);
+        TEST_ASSERT(debouncer.pending());
+
+        queue.dispatch(150);
+        TEST_ASSERT_EQUAL(1, counter);
+        TEST_ASSERT(!debouncer.pending());
+
+        // destroying the debouncer cancels the pending call
+        debouncer.trigger();
+    }
+
+    queue.dispatch(150);
+    TEST_ASSERT_EQUAL(1, counter);
+    TEST_ASSERT_EQUAL(used, used_bytes(&queue));
+}
+
+EventQueue *throttled_queue;
+Throttler *throttled;
+unsigned throttled_starts[2];
+unsigned throttled_ends[2];
+
+void throttled_slow() {
+    throttled_starts[counter] = throttled_queue->tick();
+    if (counter == 0) {
+        throttled->trigger();
+    }
+    wait_ms(150);
+    throttled_ends[counter] = throttled_queue->tick();
+    counter += 1;
+}
+
+void throttled_delete() {
+    counter += 1;
+    delete throttled;
+}
+
+void throttler_test() {
+    counter = 0;
+    EventQueue queue(2048);
+    size_t used = used_bytes(&queue);
+
+    {
+        Throttler throttler(&queue, 100, increment);
+
+        // the first trigger calls immediately, later triggers within the
+        // period collapse into a single call at the end of the period
+        throttler.trigger();
+        queue.dispatch(0);
+        TEST_ASSERT_EQUAL(1, counter);
+
+        int id = throttler.trigger();
+        TEST_ASSERT_NOT_EQUAL(0, id);
+        TEST_ASSERT_EQUAL(id, throttler.trigger());
+        TEST_ASSERT_EQUAL(id, throttler.trigger());
+        queue.dispatch(50);
+        TEST_ASSERT_EQUAL(1, counter);
+        queue.dispatch(100);
+        TEST_ASSERT_EQUAL(2, counter);
+    }
+
+    // a trigger during a slow call waits a full period after it returns
+    counter = 0;
+    throttled_queue = &queue;
+    throttled = new Throttler(&queue, 100, throttled_slow);
+    throttled->trigger();
+    queue.dispatch(500);
+    TEST_ASSERT_EQUAL(2, counter);
+    TEST_ASSERT_INT_WITHIN(5, 100, throttled_starts[1] - throttled_ends[0]);
+    delete throttled;
+
+    // the throttler can be destroyed from within its own function
+    counter = 0;
+    throttled = new Throttler(&queue, 100, throttled_delete);
+    throttled->trigger();
+    queue.dispatch(0);
+    TEST_ASSERT_EQUAL(1, counter);
+
+    TEST_ASSERT_EQUAL(used, used_bytes(&queue));
+}
+
 
 // Test setup
 utest::v1::status_t test_setup(const size_t number_of_cases) {
@@ -257,6 +388,9 @@ const Case cases[] = {
     Case("Testing the event class", event_class_test),
     Case("Testing the event class helpers", event_class_helper_test),
     Case("Testing the event inference", event_inference_test),
+    Case("Testing event coalescing", event_coalesce_test),
+    Case("Testing the debouncer", debouncer_test),
+    Case("Testing the throttler", throttler_test),
 };
 
 Specification specification(test_setup, cases);
@@ -0,0 +1,72 @@
+#include "Throttler.h"
+
+#include "mbed_events.h"
+
+
+Throttler::Throttler(EventQueue *q, int ms, mbed::Callback<void()> f)
+    : _equeue(&q->_equeue), _ms(ms), _f(f), _id(0) {
+    _event = static_cast<struct event*>(
+            equeue_alloc(_equeue, sizeof(struct event)));
+    if (_event) {
+        _event->throttler = this;
+        _event->equeue = _equeue;
+        _event->last = 0;
+        _event->called = false;
+    }
+}
+
+Throttler::~Throttler() {
+    if (_event) {
+        equeue_release(_equeue, _event);
+    }
+}
+
+int Throttler::trigger() {
+    if (!_event) {
+        return 0;
+    }
+
+    // collapse into the pending call
+    int id = _id;
+    if (equeue_pending(_equeue, id)) {
+        return id;
+    }
+
+    int delay = 0;
+    if (_event->called) {
+        delay = (int)(_event->last + _ms - equeue_now(_equeue));
+        if (delay < 0) {
+            delay = 0;
+        }
+    }
+
+    _id = equeue_repost(_equeue, &Throttler::dispatch, _event, delay);
+    return _id;
+}
+
+void Throttler::cancel() {
+    equeue_cancel(_equeue, _id);
+}
+
+bool Throttler::pending() {
+    return equeue_pending(_equeue, _id);
+}
+
+void Throttler::dispatch(void *p) {
+    struct event *e = static_cast<struct event*>(p);
+    Throttler *t = e->throttler;
+
+    // a trigger during the previous call was scheduled before that call
+    // returned, so hold it back until a full period has passed
+    if (e->called) {
+        int delay = (int)(e->last + t->_ms - equeue_now(e->equeue));
+        if (delay > 0) {
+            t->_id = equeue_repost(e->equeue, &Throttler::dispatch, e, delay);
+            return;
+        }
+    }
+
+    t->_f();
+    e->last = equeue_now(e->equeue);
+    e->called = true;
+}
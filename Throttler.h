@@ -0,0 +1,104 @@
+/* events
+ * Copyright (c) 2006-2013 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef THROTTLER_H
+#define THROTTLER_H
+
+#include "EventQueue.h"
+
+namespace events {
+
+/** Throttler
+ *
+ *  Calls a function on an event queue at most once per period
+ *
+ *  A trigger outside of the period executes the function immediately,
+ *  while triggers within the period collapse into a single call at the
+ *  end of the period. The period is measured on the event queue's clock
+ *  from when the previous call returned. The throttler reposts a single
+ *  preallocated event, so triggering does not allocate memory.
+ */
+class Throttler {
+public:
+    /** Create a throttler
+     *
+     *  Allocates the throttler's event from the event queue. If there is
+     *  not enough memory, every trigger returns an id of 0.
+     *
+     *  @param q        Event queue to dispatch on
+     *  @param ms       Minimum period between calls in milliseconds
+     *  @param f        Function to execute
+     */
+    Throttler(EventQueue *q, int ms, mbed::Callback<void()> f);
+
+    /** Destroy a throttler
+     *
+     *  Cancels any pending call and frees the throttler's event. If the
+     *  function is executing, the event is freed once it returns, so the
+     *  throttler may be destroyed from within its own function.
+     */
+    ~Throttler();
+
+    /** Trigger the throttler
+     *
+     *  Schedules the function to execute as soon as the period since the
+     *  last call has passed. If a call is already pending, the trigger
+     *  collapses into it.
+     *
+     *  The trigger function is irq safe.
+     *
+     *  @return         A unique id that represents the pending call, or 0
+     *                  if the throttler's event could not be allocated
+     */
+    int trigger();
+
+    /** Cancel a pending call
+     *
+     *  The cancel function is irq safe.
+     */
+    void cancel();
+
+    /** Check for a pending call
+     *
+     *  @return         True if the function is scheduled and has not
+     *                  started executing
+     */
+    bool pending();
+
+private:
+    Throttler(const Throttler &);
+    Throttler &operator=(const Throttler &);
+
+    // the time of the last call lives in the event, so it can be recorded
+    // even if the throttler is destroyed during the call
+    struct event {
+        Throttler *throttler;
+        equeue_t *equeue;
+        unsigned last;
+        bool called;
+    };
+
+    static void dispatch(void *p);
+
+    equeue_t *_equeue;
+    int _ms;
+    mbed::Callback<void()> _f;
+    struct event *_event;
+    int _id;
+};
+
+}
+
+#endif
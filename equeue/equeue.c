@@ -23,10 +23,99 @@ static inline int equeue_clampdiff(unsigned a, unsigned b) {
     return ~(diff >> (8*sizeof(int)-1)) & diff;
 }
 
+// Counters updated by the dispatching thread without holding queuelock,
+// with a single writer a relaxed load and store is enough, so these
+// compile to plain loads and stores without read-modify-write atomics
+#if defined(__ATOMIC_RELAXED)
+#define EQUEUE_COUNT(c) __atomic_store_n(&(c), \
+        __atomic_load_n(&(c), __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED)
+#define EQUEUE_COUNTER(c) __atomic_load_n(&(c), __ATOMIC_RELAXED)
+#else
+#define EQUEUE_COUNT(c) ((c) += 1)
+#define EQUEUE_COUNTER(c) (c)
+#endif
+
+// Current tick of the queue's clock
+static inline unsigned equeue_clock_tick(equeue_t *q) {
+    if (q->clock.tick) {
+        return q->clock.tick(q->clock.clock);
+    }
+
+    return equeue_tick();
+}
+
+// Pass an operation to the recorder if one is attached
+static inline void equeue_emit(equeue_t *q, uint8_t op,
+        struct equeue_event *e, int id, int arg, int period) {
+    struct equeue_record r;
+    r.op = op;
+    r.tick = equeue_clock_tick(q);
+    r.offset = e ? (unsigned)((unsigned char *)e - q->buffer) : -1;
+    r.id = id;
+    r.arg = arg;
+    r.period = period;
+    q->recorder.record(q->recorder.recorder, &r);
+}
+
+// Append a record to the trace ring if one is attached
+#ifdef EQUEUE_TRACE
+static inline uint64_t equeue_trace_stamp(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t a, b;
+    __asm__ volatile ("rdtsc" : "=a" (a), "=d" (b));
+    return ((uint64_t)b << 32) | (uint64_t)a;
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ volatile ("mrs %0, cntvct_el0" : "=r" (v));
+    return v;
+#else
+    return (uint64_t)equeue_tick() * 1000;
+#endif
+}
+
+static inline void equeue_trace_emit(equeue_t *q, uint8_t op, int id) {
+    if (!__atomic_load_n(&q->trace.buffer, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    // register as a writer before loading the buffer, so equeue_trace can
+    // wait for writers to leave the old buffer, the buffer is published
+    // after its mask
+    __atomic_fetch_add(&q->trace.writers, 1, __ATOMIC_SEQ_CST);
+    struct equeue_trace_record *buffer =
+            __atomic_load_n(&q->trace.buffer, __ATOMIC_SEQ_CST);
+    if (buffer) {
+        unsigned n = __atomic_fetch_add(&q->trace.head, 1, __ATOMIC_RELAXED);
+        struct equeue_trace_record *r = &buffer[n & q->trace.mask];
+        r->stamp = equeue_trace_stamp();
+        r->id = id;
+        r->op = op;
+    }
+    __atomic_fetch_sub(&q->trace.writers, 1, __ATOMIC_RELEASE);
+}
+
+#define EQUEUE_TRACE_EMIT(q, op, id) equeue_trace_emit(q, op, id)
+#else
+#define EQUEUE_TRACE_EMIT(q, op, id)
+#endif
+
+// USDT probes for tools such as bpftrace and perf, these compile to a
+// single nop each unless a tracer is attached
+#ifdef EQUEUE_USDT
+#include <sys/sdt.h>
+#define EQUEUE_PROBE2(name, a, b) DTRACE_PROBE2(equeue, name, a, b)
+#define EQUEUE_PROBE3(name, a, b, c) DTRACE_PROBE3(equeue, name, a, b, c)
+#define EQUEUE_PROBE4(name, a, b, c, d) DTRACE_PROBE4(equeue, name, a, b, c, d)
+#else
+#define EQUEUE_PROBE2(name, a, b)
+#define EQUEUE_PROBE3(name, a, b, c)
+#define EQUEUE_PROBE4(name, a, b, c, d)
+#endif
+
 // Increment the unique id in an event, hiding the event from cancel
 static inline void equeue_incid(equeue_t *q, struct equeue_event *e) {
     e->id += 1;
-    if (!(e->id << q->npw2)) {
+    if (!((unsigned)e->id << q->npw2)) {
         e->id = 1;
     }
 }
@@ -63,11 +152,38 @@ int equeue_create_inplace(equeue_t *q, size_t size, void *buffer) {
     q->tick = equeue_tick();
     q->generation = 0;
     q->breaks = 0;
+    q->updates = 0;
 
     q->background.active = false;
     q->background.update = 0;
     q->background.timer = 0;
 
+    q->clock.tick = 0;
+    q->clock.advance = 0;
+    q->clock.clock = 0;
+
+    q->recorder.record = 0;
+    q->recorder.recorder = 0;
+
+    q->hooks = 0;
+    q->hookwalks = 0;
+    q->hookwaiters = 0;
+    q->used = 0;
+    q->memwaiters = 0;
+    q->memstale = 0;
+    q->memfrees = 0;
+    q->overload = EQUEUE_OVERLOAD_DROP_NEW;
+    q->alert.alert = 0;
+    q->alert.high = false;
+    memset(&q->counters, 0, sizeof(q->counters));
+
+#ifdef EQUEUE_TRACE
+    q->trace.buffer = 0;
+    q->trace.mask = 0;
+    q->trace.head = 0;
+    q->trace.writers = 0;
+#endif
+
     // initialize platform resources
     int err;
     err = equeue_sema_create(&q->eventsema);
@@ -85,6 +201,16 @@ int equeue_create_inplace(equeue_t *q, size_t size, void *buffer) {
         return err;
     }
 
+    err = equeue_sema_create(&q->memsema);
+    if (err < 0) {
+        return err;
+    }
+
+    err = equeue_sema_create(&q->hooksema);
+    if (err < 0) {
+        return err;
+    }
+
     return 0;
 }
 
@@ -104,6 +230,8 @@ void equeue_destroy(equeue_t *q) {
     }
 
     // clean up platform resources + memory
+    equeue_sema_destroy(&q->hooksema);
+    equeue_sema_destroy(&q->memsema);
     equeue_mutex_destroy(&q->memlock);
     equeue_mutex_destroy(&q->queuelock);
     equeue_sema_destroy(&q->eventsema);
@@ -112,43 +240,117 @@ void equeue_destroy(equeue_t *q) {
 
 
 // equeue chunk allocation functions
-static struct equeue_event *equeue_mem_alloc(equeue_t *q, size_t size) {
+enum {
+    EQUEUE_MEM_WAIT  = 0x1, // register as a waiter instead of failing
+    EQUEUE_MEM_RETRY = 0x2, // request was already counted
+};
+
+static bool equeue_evict(equeue_t *q, size_t size);
+
+static struct equeue_event *equeue_mem_alloc(equeue_t *q, size_t size,
+        unsigned flags, unsigned *seen) {
+    // find bucket of requested size
+    size_t request = size;
+    unsigned bucket = 0;
+    for (size_t s = (size-1) >> 3; size && s &&
+            bucket < EQUEUE_MEM_BUCKETS-1; s >>= 1) {
+        bucket++;
+    }
+
     // add event overhead
     size += sizeof(struct equeue_event);
     size = (size + sizeof(void*)-1) & ~(sizeof(void*)-1);
 
     equeue_mutex_lock(&q->memlock);
-
-    // check if a good chunk is available
-    for (struct equeue_event **p = &q->chunks; *p; p = &(*p)->next) {
-        if ((*p)->size >= size) {
-            struct equeue_event *e = *p;
-            if (e->sibling) {
-                *p = e->sibling;
-                (*p)->next = e->next;
-            } else {
-                *p = e->next;
+    if (!(flags & EQUEUE_MEM_RETRY)) {
+        q->counters.requests[bucket] += 1;
+    }
+    struct equeue_event *e = 0;
+
+    while (true) {
+        // check if a good chunk is available
+        for (struct equeue_event **p = &q->chunks; *p; p = &(*p)->next) {
+            if ((*p)->size >= size) {
+                e = *p;
+                if (e->sibling) {
+                    *p = e->sibling;
+                    (*p)->next = e->next;
+                } else {
+                    *p = e->next;
+                }
+                break;
             }
+        }
 
-            equeue_mutex_unlock(&q->memlock);
-            return e;
+        // otherwise allocate a new chunk out of the slab
+        if (!e && q->slab.size >= size) {
+            e = (struct equeue_event *)q->slab.data;
+            q->slab.data += size;
+            q->slab.size -= size;
+            e->size = size;
+            e->id = 1;
         }
-    }
 
-    // otherwise allocate a new chunk out of the slab
-    if (q->slab.size >= size) {
-        struct equeue_event *e = (struct equeue_event *)q->slab.data;
-        q->slab.data += size;
-        q->slab.size -= size;
-        e->size = size;
-        e->id = 1;
+        // otherwise shed a pending event if the overload policy allows,
+        // waiters only shed once they give up
+        if (e || (flags & EQUEUE_MEM_WAIT) ||
+                q->overload == EQUEUE_OVERLOAD_DROP_NEW) {
+            break;
+        }
+
+        equeue_mutex_unlock(&q->memlock);
+        bool evicted = equeue_evict(q, size);
+        equeue_mutex_lock(&q->memlock);
+        if (!evicted) {
+            break;
+        }
+    }
 
+    if (e) {
+        q->used += e->size;
+    } else if (flags & EQUEUE_MEM_WAIT) {
+        // waiters are registered under the same lock so deallocations
+        // can't be missed, failures are only counted once waiting ends
+        q->memwaiters += 1;
+        *seen = q->memfrees;
         equeue_mutex_unlock(&q->memlock);
-        return e;
+        return 0;
+    } else {
+        q->counters.alloc_failures += 1;
     }
 
+    // check for alerts while the usage is consistent
+    struct equeue_alert_info info = {0};
+    void (*alert)(void *, const struct equeue_alert_info *) = 0;
+    void *data = q->alert.data;
+    if (q->alert.alert) {
+        if (!e) {
+            info.type = EQUEUE_ALERT_ALLOC_FAILURE;
+            alert = q->alert.alert;
+        } else if (q->alert.highwater && !q->alert.high &&
+                q->used >= q->alert.highwater) {
+            info.type = EQUEUE_ALERT_HIGHWATER;
+            q->alert.high = true;
+            alert = q->alert.alert;
+        }
+
+        info.size = request;
+        info.used = q->used;
+        info.slab_used = q->slab.data - q->buffer;
+        info.slab_free = q->slab.size;
+        info.free_bytes = info.slab_used - info.used;
+    }
     equeue_mutex_unlock(&q->memlock);
-    return 0;
+
+    if (!e) {
+        EQUEUE_PROBE2(alloc_failure, q, size);
+    }
+
+    if (alert) {
+        alert(data, &info);
+    }
+
+    return e;
 }
 
 static void equeue_mem_dealloc(equeue_t *q, struct equeue_event *e) {
@@ -169,11 +371,32 @@ static void equeue_mem_dealloc(equeue_t *q, struct equeue_event *e) {
     }
     *p = e;
 
+    // rearm the high-water alert once usage drops below the mark
+    q->used -= e->size;
+    if (q->alert.high && q->used < q->alert.highwater) {
+        q->alert.high = false;
+    }
+
+    // every registered waiter gets to retry once per deallocation
+    bool waiters = q->memwaiters > 0;
+    if (waiters) {
+        q->memfrees += 1;
+        q->memstale = q->memwaiters;
+    }
     equeue_mutex_unlock(&q->memlock);
+
+    // only pay for the semaphore if someone is blocked on memory
+    if (waiters) {
+        equeue_sema_signal(&q->memsema);
+    }
 }
 
-void *equeue_alloc(equeue_t *q, size_t size) {
-    struct equeue_event *e = equeue_mem_alloc(q, size);
+static void *equeue_mem_init(equeue_t *q, size_t size, int window,
+        struct equeue_event *e) {
+    if (q->recorder.record) {
+        equeue_emit(q, EQUEUE_RECORD_ALLOC, e, 0, size, window);
+    }
+
     if (!e) {
         return 0;
     }
@@ -181,13 +404,79 @@ void *equeue_alloc(equeue_t *q, size_t size) {
     e->target = 0;
     e->period = -1;
     e->dtor = 0;
+    e->flags = 0;
+    e->priority = 0;
 
     return e + 1;
 }
 
-void equeue_dealloc(equeue_t *q, void *p) {
-    struct equeue_event *e = (struct equeue_event*)p - 1;
+void *equeue_alloc(equeue_t *q, size_t size) {
+    return equeue_mem_init(q, size, -1, equeue_mem_alloc(q, size, 0, 0));
+}
+
+void *equeue_alloc_wait(equeue_t *q, size_t size, int ms) {
+    unsigned tick = equeue_tick();
+    unsigned flags = 0;
+    unsigned seen = 0;
+    struct equeue_event *e;
+
+    while (true) {
+        int remaining = ms;
+        if (ms > 0) {
+            remaining = equeue_clampdiff(tick + ms, equeue_tick());
+        }
+
+        e = equeue_mem_alloc(q, size,
+                flags | (remaining ? EQUEUE_MEM_WAIT : 0), &seen);
+        if (e || !remaining) {
+            break;
+        }
 
+        equeue_sema_wait(&q->memsema, remaining);
+
+        // the semaphore only wakes a single waiter, so pass the wakeup on
+        // while other waiters have yet to retry since the last deallocation,
+        // whether or not this waiter's retry succeeds
+        equeue_mutex_lock(&q->memlock);
+        q->memwaiters -= 1;
+        if (seen != q->memfrees) {
+            q->memstale -= 1;
+        }
+        bool stale = q->memstale > 0;
+        equeue_mutex_unlock(&q->memlock);
+
+        if (stale) {
+            equeue_sema_signal(&q->memsema);
+        }
+        flags = EQUEUE_MEM_RETRY;
+    }
+
+    return equeue_mem_init(q, size, -1, e);
+}
+
+// expiring events keep their window in the last int of their chunk,
+// which lies past the event's data
+static inline int *equeue_window(struct equeue_event *e) {
+    return (int *)((unsigned char *)e + e->size) - 1;
+}
+
+void *equeue_alloc_expire(equeue_t *q, size_t size, int ms) {
+    if (ms < 0) {
+        return equeue_alloc(q, size);
+    }
+
+    void *p = equeue_mem_init(q, size, ms,
+            equeue_mem_alloc(q, size + sizeof(int), 0, 0));
+    if (p) {
+        struct equeue_event *e = (struct equeue_event*)p - 1;
+        e->flags |= EQUEUE_EVENT_EXPIRE;
+        *equeue_window(e) = ms;
+    }
+
+    return p;
+}
+
+static void equeue_free(equeue_t *q, struct equeue_event *e) {
     if (e->dtor) {
         e->dtor(e+1);
     }
@@ -195,16 +484,57 @@ void equeue_dealloc(equeue_t *q, void *p) {
     equeue_mem_dealloc(q, e);
 }
 
+void equeue_dealloc(equeue_t *q, void *p) {
+    struct equeue_event *e = (struct equeue_event*)p - 1;
+    if (q->recorder.record) {
+        equeue_emit(q, EQUEUE_RECORD_DEALLOC, e, 0, 0, 0);
+    }
+
+    equeue_free(q, e);
+}
+
 
 // equeue scheduling functions
-static int equeue_enqueue(equeue_t *q, struct equeue_event *e, unsigned tick) {
-    // setup event and hash local id with buffer offset for unique id
-    int id = (e->id << q->npw2) | ((unsigned char *)e - q->buffer);
+// checks if an event is waiting in the queue rather than being dispatched,
+// must hold queuelock
+static bool equeue_isqueued(equeue_t *q, struct equeue_event *e) {
+    int diff = equeue_tickdiff(e->target, q->tick);
+    return !(diff < 0 || (diff == 0 && e->generation != q->generation));
+}
+
+// checks if an id refers to an event waiting in the queue, must hold
+// queuelock
+static bool equeue_ispending(equeue_t *q, int id) {
+    if (!id) {
+        return false;
+    }
+
+    struct equeue_event *e = (struct equeue_event *)
+            &q->buffer[id & ((1 << q->npw2)-1)];
+    if (e->id != (unsigned)id >> q->npw2) {
+        return false;
+    }
+
+    return equeue_isqueued(q, e);
+}
+
+// counts a newly pending event, must hold queuelock
+static void equeue_count_post(equeue_t *q) {
+    q->counters.posted += 1;
+    unsigned pending = q->counters.posted
+            - q->counters.cancelled - q->counters.evicted
+            - EQUEUE_COUNTER(q->counters.completed);
+    if (pending > q->counters.peak) {
+        q->counters.peak = pending;
+    }
+}
+
+// inserts an event into the queue, must hold queuelock
+static void equeue_insert(equeue_t *q, struct equeue_event *e,
+        unsigned tick) {
     e->target = tick + equeue_clampdiff(e->target, tick);
     e->generation = q->generation;
 
-    equeue_mutex_lock(&q->queuelock);
-
     // find the event slot
     struct equeue_event **p = &q->queue;
     while (*p && equeue_tickdiff((*p)->target, e->target) < 0) {
@@ -219,6 +549,7 @@ static int equeue_enqueue(equeue_t *q, struct equeue_event *e, unsigned tick) {
         }
 
         e->sibling = *p;
+        e->sibling->next = 0;
         e->sibling->ref = &e->sibling;
     } else {
         e->next = *p;
@@ -231,6 +562,7 @@ static int equeue_enqueue(equeue_t *q, struct equeue_event *e, unsigned tick) {
 
     *p = e;
     e->ref = p;
+    q->updates += 1;
 
     // notify background timer
     if ((q->background.update && q->background.active) &&
@@ -238,19 +570,77 @@ static int equeue_enqueue(equeue_t *q, struct equeue_event *e, unsigned tick) {
         q->background.update(q->background.timer,
                 equeue_clampdiff(e->target, tick));
     }
+}
+
+static int equeue_enqueue(equeue_t *q, struct equeue_event *e, unsigned tick,
+        int *token, int *pending, bool record) {
+    // hash local id with buffer offset for unique id
+    int id = ((unsigned)e->id << q->npw2) | ((unsigned char *)e - q->buffer);
+
+    equeue_mutex_lock(&q->queuelock);
+
+    // coalesce with the token's event if it is still pending, the token
+    // may be rewritten as soon as we unlock so capture its id here
+    if (token) {
+        if (equeue_ispending(q, *token)) {
+            *pending = *token;
+            equeue_mutex_unlock(&q->queuelock);
+            return 0;
+        }
+
+        *token = id;
+    }
+
+    // record the post while the event can't be dispatched yet, so the post
+    // always precedes its dispatch in the recording
+    if (record && q->recorder.record) {
+        equeue_emit(q, EQUEUE_RECORD_POST, e, id,
+                equeue_tickdiff(e->target, tick), e->period);
+    }
 
+    equeue_insert(q, e, tick);
+    equeue_count_post(q);
     equeue_mutex_unlock(&q->queuelock);
 
     return id;
 }
 
+// removes a pending event from the queue, must hold queuelock
+static void equeue_disentangle(equeue_t *q, struct equeue_event *e) {
+    if (e->sibling) {
+        e->sibling->next = e->next;
+        if (e->sibling->next) {
+            e->sibling->next->ref = &e->sibling->next;
+        }
+
+        *e->ref = e->sibling;
+        e->sibling->ref = e->ref;
+    } else {
+        *e->ref = e->next;
+        if (e->next) {
+            e->next->ref = e->ref;
+        }
+    }
+
+    equeue_incid(q, e);
+    q->updates += 1;
+}
+
 static struct equeue_event *equeue_unqueue(equeue_t *q, int id) {
     // decode event from unique id and check that the local id matches
     struct equeue_event *e = (struct equeue_event *)
             &q->buffer[id & ((1 << q->npw2)-1)];
 
     equeue_mutex_lock(&q->queuelock);
-    if (e->id != id >> q->npw2) {
+    if (e->id != (unsigned)id >> q->npw2) {
+        equeue_mutex_unlock(&q->queuelock);
+        return 0;
+    }
+
+    // a repost requested while dispatching has not been inserted yet
+    if (e->flags & EQUEUE_EVENT_REPOST) {
+        e->flags &= ~EQUEUE_EVENT_REPOST;
+        equeue_incid(q, e);
         equeue_mutex_unlock(&q->queuelock);
         return 0;
     }
@@ -265,29 +655,71 @@ static struct equeue_event *equeue_unqueue(equeue_t *q, int id) {
         return 0;
     }
 
-    // disentangle from queue
-    if (e->sibling) {
-        e->sibling->next = e->next;
-        if (e->sibling->next) {
-            e->sibling->next->ref = &e->sibling->next;
+    equeue_disentangle(q, e);
+    q->counters.cancelled += 1;
+
+    // persistent events are kept for reposting
+    if (e->flags & EQUEUE_EVENT_PERSISTENT) {
+        e->flags |= EQUEUE_EVENT_IDLE;
+        e = 0;
+    }
+    equeue_mutex_unlock(&q->queuelock);
+
+    return e;
+}
+
+static bool equeue_evict(equeue_t *q, size_t size) {
+    equeue_mutex_lock(&q->queuelock);
+
+    // find a droppable event big enough to satisfy the allocation, the
+    // queue is in target order with older events later in each slot
+    struct equeue_event *victim = 0;
+    for (struct equeue_event *es = q->queue; es; es = es->next) {
+        for (struct equeue_event *e = es; e; e = e->sibling) {
+            if (!(e->flags & EQUEUE_EVENT_DROPPABLE) ||
+                    (e->flags & EQUEUE_EVENT_PERSISTENT) || e->size < size) {
+                continue;
+            }
+
+            if (q->overload == EQUEUE_OVERLOAD_EVICT_LOWEST) {
+                // ties go to the earliest target and the oldest in a slot
+                if (!victim || e->priority < victim->priority ||
+                        (e->priority == victim->priority &&
+                         e->target == victim->target)) {
+                    victim = e;
+                }
+            } else if (!victim || e->target == victim->target) {
+                victim = e;
+            }
         }
 
-        *e->ref = e->sibling;
-        e->sibling->ref = e->ref;
-    } else {
-        *e->ref = e->next;
-        if (e->next) {
-            e->next->ref = e->ref;
+        if (victim && q->overload == EQUEUE_OVERLOAD_EVICT_OLDEST) {
+            break;
         }
     }
 
-    equeue_incid(q, e);
+    if (!victim) {
+        equeue_mutex_unlock(&q->queuelock);
+        return false;
+    }
+
+    int id = ((unsigned)victim->id << q->npw2)
+            | ((unsigned char *)victim - q->buffer);
+    equeue_disentangle(q, victim);
+    q->counters.evicted += 1;
     equeue_mutex_unlock(&q->queuelock);
 
-    return e;
+    EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_CANCEL, id);
+    if (q->recorder.record) {
+        equeue_emit(q, EQUEUE_RECORD_CANCEL, victim, id, 0, 0);
+    }
+
+    equeue_free(q, victim);
+    return true;
 }
 
-static struct equeue_event *equeue_dequeue(equeue_t *q, unsigned target) {
+static struct equeue_event *equeue_dequeue(equeue_t *q, unsigned target,
+        struct equeue_hook **hooks) {
     equeue_mutex_lock(&q->queuelock);
 
     // find all expired events and mark a new generation
@@ -308,6 +740,14 @@ static struct equeue_event *equeue_dequeue(equeue_t *q, unsigned target) {
     }
 
     *p = 0;
+    q->updates += 1;
+
+    // snapshot the hooks for the whole batch, so every callback sees the
+    // same hooks for both pre and post
+    *hooks = head ? q->hooks : 0;
+    if (*hooks) {
+        q->hookwalks += 1;
+    }
 
     equeue_mutex_unlock(&q->queuelock);
 
@@ -331,25 +771,131 @@ static struct equeue_event *equeue_dequeue(equeue_t *q, unsigned target) {
     return head;
 }
 
-int equeue_post(equeue_t *q, void (*cb)(void*), void *p) {
+static int equeue_post_token(equeue_t *q, int *token,
+        void (*cb)(void*), void *p) {
     struct equeue_event *e = (struct equeue_event*)p - 1;
-    unsigned tick = equeue_tick();
+    unsigned tick = equeue_clock_tick(q);
+#ifdef EQUEUE_USDT
+    int delay = e->target;
+#endif
     e->cb = cb;
     e->target = tick + e->target;
 
-    int id = equeue_enqueue(q, e, tick);
+    int pending = 0;
+    int id = equeue_enqueue(q, e, tick, token, &pending, true);
+    if (!id) {
+        // already pending, so the new event is redundant
+        equeue_dealloc(q, p);
+        return pending;
+    }
+
+    EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_POST, id);
+    EQUEUE_PROBE4(post, q, id, cb, delay);
     equeue_sema_signal(&q->eventsema);
+
     return id;
 }
 
+int equeue_post(equeue_t *q, void (*cb)(void*), void *p) {
+    return equeue_post_token(q, 0, cb, p);
+}
+
+int equeue_post_unique(equeue_t *q, int *token,
+        void (*cb)(void*), void *p) {
+    return equeue_post_token(q, token, cb, p);
+}
+
+int equeue_repost(equeue_t *q, void (*cb)(void*), void *p, int ms) {
+    struct equeue_event *e = (struct equeue_event*)p - 1;
+    unsigned tick = equeue_clock_tick(q);
+    bool insert = true;
+
+    equeue_mutex_lock(&q->queuelock);
+    if (!(e->flags & EQUEUE_EVENT_PERSISTENT) ||
+            (e->flags & EQUEUE_EVENT_IDLE)) {
+        // first post, or the event has finished dispatching
+        e->flags = (e->flags & ~EQUEUE_EVENT_IDLE) | EQUEUE_EVENT_PERSISTENT;
+        equeue_count_post(q);
+    } else if (!(e->flags & EQUEUE_EVENT_REPOST) && equeue_isqueued(q, e)) {
+        // still waiting, move the event to its new target
+        equeue_disentangle(q, e);
+    } else {
+        // dispatching, the dispatch loop inserts the event once the
+        // callback returns
+        if (!(e->flags & EQUEUE_EVENT_REPOST)) {
+            e->flags |= EQUEUE_EVENT_REPOST;
+            equeue_incid(q, e);
+        }
+        insert = false;
+    }
+
+    e->cb = cb;
+    e->period = -1;
+    e->target = tick + ms;
+    if (insert) {
+        equeue_insert(q, e, tick);
+    }
+
+    int id = ((unsigned)e->id << q->npw2) | ((unsigned char *)e - q->buffer);
+    if (q->recorder.record) {
+        equeue_emit(q, EQUEUE_RECORD_REPOST, e, id, ms, -1);
+    }
+    equeue_mutex_unlock(&q->queuelock);
+
+    EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_POST, id);
+    EQUEUE_PROBE4(post, q, id, cb, ms);
+    if (insert) {
+        equeue_sema_signal(&q->eventsema);
+    }
+
+    return id;
+}
+
+void equeue_release(equeue_t *q, void *p) {
+    struct equeue_event *e = (struct equeue_event*)p - 1;
+
+    equeue_mutex_lock(&q->queuelock);
+    if ((e->flags & EQUEUE_EVENT_PERSISTENT) &&
+            !(e->flags & EQUEUE_EVENT_IDLE)) {
+        if (!(e->flags & EQUEUE_EVENT_REPOST) && equeue_isqueued(q, e)) {
+            // still waiting, take the event out of the queue
+            equeue_disentangle(q, e);
+            q->counters.cancelled += 1;
+        } else {
+            // dispatching, the dispatch loop frees the event once the
+            // callback returns
+            e->flags = (e->flags & ~EQUEUE_EVENT_REPOST)
+                    | EQUEUE_EVENT_RELEASE;
+            equeue_mutex_unlock(&q->queuelock);
+            return;
+        }
+    }
+    equeue_mutex_unlock(&q->queuelock);
+
+    equeue_dealloc(q, p);
+}
+
+bool equeue_pending(equeue_t *q, int id) {
+    equeue_mutex_lock(&q->queuelock);
+    bool pending = equeue_ispending(q, id);
+    equeue_mutex_unlock(&q->queuelock);
+    return pending;
+}
+
 void equeue_cancel(equeue_t *q, int id) {
     if (!id) {
         return;
     }
 
+    if (q->recorder.record) {
+        equeue_emit(q, EQUEUE_RECORD_CANCEL, 0, id, 0, 0);
+    }
+    EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_CANCEL, id);
+    EQUEUE_PROBE2(cancel, q, id);
+
     struct equeue_event *e = equeue_unqueue(q, id);
     if (e) {
-        equeue_dealloc(q, e + 1);
+        equeue_free(q, e);
     }
 }
 
@@ -360,38 +906,126 @@ void equeue_break(equeue_t *q) {
     equeue_sema_signal(&q->eventsema);
 }
 
+// walks of the hook list are counted, so the list is only modified while
+// no walk is in progress, walks are entered by equeue_dequeue
+static void equeue_hooks_leave(equeue_t *q) {
+    equeue_mutex_lock(&q->queuelock);
+    q->hookwalks -= 1;
+    if (!q->hookwalks && q->hookwaiters) {
+        equeue_sema_signal(&q->hooksema);
+    }
+    equeue_mutex_unlock(&q->queuelock);
+}
+
+static void equeue_dispatch_hooked(equeue_t *q, struct equeue_hook *hooks,
+        struct equeue_event *e, void (*cb)(void *), int id) {
+    struct equeue_dispatch_info info;
+    info.event = e + 1;
+    info.cb = cb;
+    info.fn = (e->flags & EQUEUE_EVENT_WRAPPED)
+            ? *(void (**)(void *))(e + 1) : cb;
+    info.id = id;
+    info.target = e->target;
+    info.start = equeue_clock_tick(q);
+
+    for (struct equeue_hook *h = hooks; h; h = h->next) {
+        if (h->pre) {
+            h->pre(h->data, &info);
+        }
+    }
+
+    cb(e + 1);
+
+    for (struct equeue_hook *h = hooks; h; h = h->next) {
+        if (h->post) {
+            h->post(h->data, &info);
+        }
+    }
+}
+
 void equeue_dispatch(equeue_t *q, int ms) {
-    unsigned tick = equeue_tick();
+    unsigned tick = equeue_clock_tick(q);
     unsigned timeout = tick + ms;
     q->background.active = false;
 
     while (1) {
         // collect all the available events and next deadline
-        struct equeue_event *es = equeue_dequeue(q, tick);
+        struct equeue_hook *hooks;
+        struct equeue_event *es = equeue_dequeue(q, tick, &hooks);
+        EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_DEQUEUE, tick);
+        EQUEUE_COUNT(q->counters.passes);
 
         // dispatch events
         while (es) {
             struct equeue_event *e = es;
             es = e->next;
 
-            // actually dispatch the callbacks
+            // drop stale events that missed their window
             void (*cb)(void *) = e->cb;
+            if (cb && (e->flags & EQUEUE_EVENT_EXPIRE) && equeue_tickdiff(
+                    equeue_clock_tick(q), e->target) > *equeue_window(e)) {
+                cb = 0;
+                EQUEUE_COUNT(q->counters.expired);
+            }
+
+            // actually dispatch the callbacks
             if (cb) {
-                cb(e + 1);
+                int id = ((unsigned)e->id << q->npw2) |
+                        ((unsigned char *)e - q->buffer);
+                if (q->recorder.record) {
+                    equeue_emit(q, EQUEUE_RECORD_DISPATCH, e, id, 0, 0);
+                }
+
+                EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_START, id);
+                EQUEUE_PROBE3(callback_entry, q, id, cb);
+                if (hooks) {
+                    equeue_dispatch_hooked(q, hooks, e, cb, id);
+                } else {
+                    cb(e + 1);
+                }
+                EQUEUE_PROBE3(callback_return, q, id, cb);
+                EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_END, id);
+                EQUEUE_COUNT(q->counters.dispatched);
             }
 
-            // reenqueue periodic events or deallocate
+            // reenqueue periodic events or deallocate, periodic events
+            // count as completed and posted again
+            EQUEUE_COUNT(q->counters.completed);
             if (e->period >= 0) {
                 e->target += e->period;
-                equeue_enqueue(q, e, equeue_tick());
+                equeue_enqueue(q, e, equeue_clock_tick(q), 0, 0, false);
+            } else if (e->flags & EQUEUE_EVENT_PERSISTENT) {
+                // persistent events are kept for reposting, unless
+                // reposted or released while dispatching
+                equeue_mutex_lock(&q->queuelock);
+                bool release = e->flags & EQUEUE_EVENT_RELEASE;
+                if (release) {
+                    equeue_incid(q, e);
+                } else if (e->flags & EQUEUE_EVENT_REPOST) {
+                    e->flags &= ~EQUEUE_EVENT_REPOST;
+                    equeue_insert(q, e, equeue_clock_tick(q));
+                    equeue_count_post(q);
+                } else {
+                    equeue_incid(q, e);
+                    e->flags |= EQUEUE_EVENT_IDLE;
+                }
+                equeue_mutex_unlock(&q->queuelock);
+
+                if (release) {
+                    equeue_dealloc(q, e + 1);
+                }
             } else {
                 equeue_incid(q, e);
-                equeue_dealloc(q, e+1);
+                equeue_free(q, e);
             }
         }
 
+        if (hooks) {
+            equeue_hooks_leave(q);
+        }
+
         int deadline = -1;
-        tick = equeue_tick();
+        tick = equeue_clock_tick(q);
 
         // check if we should stop dispatching soon
         if (ms >= 0) {
@@ -421,8 +1055,15 @@ void equeue_dispatch(equeue_t *q, int ms) {
         }
         equeue_mutex_unlock(&q->queuelock);
 
-        // wait for events
-        equeue_sema_wait(&q->eventsema, deadline);
+        // wait for events, or skip straight to the deadline if the
+        // clock can be advanced
+        if (q->clock.advance && deadline > 0) {
+            q->clock.advance(q->clock.clock, deadline);
+        } else {
+            EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_WAIT, 0);
+            equeue_sema_wait(&q->eventsema, deadline);
+            EQUEUE_TRACE_EMIT(q, EQUEUE_TRACE_WAKE, 0);
+        }
 
         // check if we were notified to break out of dispatch
         if (q->breaks) {
@@ -436,7 +1077,7 @@ void equeue_dispatch(equeue_t *q, int ms) {
         }
 
         // update tick for next iteration
-        tick = equeue_tick();
+        tick = equeue_clock_tick(q);
     }
 }
 
@@ -457,8 +1098,20 @@ void equeue_event_dtor(void *p, void (*dtor)(void *)) {
     e->dtor = dtor;
 }
 
+void equeue_event_droppable(void *p, uint8_t priority) {
+    struct equeue_event *e = (struct equeue_event*)p - 1;
+    e->flags |= EQUEUE_EVENT_DROPPABLE;
+    e->priority = priority;
+}
+
+void equeue_event_wrapped(void *p) {
+    struct equeue_event *e = (struct equeue_event*)p - 1;
+    e->flags |= EQUEUE_EVENT_WRAPPED;
+}
+
 
-// simple callbacks 
+// simple callbacks, the callback comes first so events can be marked as
+// wrapped for hooks
 struct ecallback {
     void (*cb)(void*);
     void *data;
@@ -477,9 +1130,28 @@ int equeue_call(equeue_t *q, void (*cb)(void*), void *data) {
 
     e->cb = cb;
     e->data = data;
+    equeue_event_wrapped(e);
     return equeue_post(q, ecallback_dispatch, e);
 }
 
+int equeue_call_unique(equeue_t *q, int *token,
+        void (*cb)(void*), void *data) {
+    // avoid allocating if we can already tell the event is redundant
+    if (equeue_pending(q, *token)) {
+        return *token;
+    }
+
+    struct ecallback *e = equeue_alloc(q, sizeof(struct ecallback));
+    if (!e) {
+        return 0;
+    }
+
+    e->cb = cb;
+    e->data = data;
+    equeue_event_wrapped(e);
+    return equeue_post_unique(q, token, ecallback_dispatch, e);
+}
+
 int equeue_call_in(equeue_t *q, int ms, void (*cb)(void*), void *data) {
     struct ecallback *e = equeue_alloc(q, sizeof(struct ecallback));
     if (!e) {
@@ -489,6 +1161,7 @@ int equeue_call_in(equeue_t *q, int ms, void (*cb)(void*), void *data) {
     equeue_event_delay(e, ms);
     e->cb = cb;
     e->data = data;
+    equeue_event_wrapped(e);
     return equeue_post(q, ecallback_dispatch, e);
 }
 
@@ -502,6 +1175,7 @@ int equeue_call_every(equeue_t *q, int ms, void (*cb)(void*), void *data) {
     equeue_event_period(e, ms);
     e->cb = cb;
     e->data = data;
+    equeue_event_wrapped(e);
     return equeue_post(q, ecallback_dispatch, e);
 }
 
@@ -519,7 +1193,7 @@ void equeue_background(equeue_t *q,
 
     if (q->background.update && q->queue) {
         q->background.update(q->background.timer,
-                equeue_clampdiff(q->queue->target, equeue_tick()));
+                equeue_clampdiff(q->queue->target, equeue_clock_tick(q)));
     }
     q->background.active = true;
     equeue_mutex_unlock(&q->queuelock);
@@ -561,3 +1235,290 @@ void equeue_chain(equeue_t *q, equeue_t *target) {
 
     equeue_background(q, equeue_chain_update, c);
 }
+
+
+// dispatch hooks
+// waits for walks of the hook list to finish, returns holding queuelock
+static void equeue_hooks_lock(equeue_t *q) {
+    equeue_mutex_lock(&q->queuelock);
+    while (q->hookwalks) {
+        q->hookwaiters += 1;
+        equeue_mutex_unlock(&q->queuelock);
+        equeue_sema_wait(&q->hooksema, -1);
+        equeue_mutex_lock(&q->queuelock);
+        q->hookwaiters -= 1;
+    }
+
+    // pass the wakeup on to other waiters
+    if (q->hookwaiters) {
+        equeue_sema_signal(&q->hooksema);
+    }
+}
+
+void equeue_hook(equeue_t *q, struct equeue_hook *hook) {
+    equeue_hooks_lock(q);
+    struct equeue_hook **p = &q->hooks;
+    while (*p) {
+        p = &(*p)->next;
+    }
+
+    hook->next = 0;
+    *p = hook;
+    equeue_mutex_unlock(&q->queuelock);
+}
+
+void equeue_unhook(equeue_t *q, struct equeue_hook *hook) {
+    equeue_hooks_lock(q);
+    for (struct equeue_hook **p = &q->hooks; *p; p = &(*p)->next) {
+        if (*p == hook) {
+            *p = hook->next;
+            break;
+        }
+    }
+    equeue_mutex_unlock(&q->queuelock);
+}
+
+
+// statistics
+void equeue_stats(equeue_t *q, struct equeue_stats *stats) {
+    equeue_mutex_lock(&q->queuelock);
+    stats->posted = q->counters.posted;
+    stats->cancelled = q->counters.cancelled;
+    stats->evicted = q->counters.evicted;
+    stats->peak_pending = q->counters.peak;
+    stats->dispatched = EQUEUE_COUNTER(q->counters.dispatched);
+    stats->expired = EQUEUE_COUNTER(q->counters.expired);
+    stats->passes = EQUEUE_COUNTER(q->counters.passes);
+    stats->pending = q->counters.posted
+            - q->counters.cancelled - q->counters.evicted
+            - EQUEUE_COUNTER(q->counters.completed);
+    equeue_mutex_unlock(&q->queuelock);
+
+    equeue_mutex_lock(&q->memlock);
+    stats->alloc_failures = q->counters.alloc_failures;
+    stats->slab_used = q->slab.data - q->buffer;
+    stats->free_bytes = 0;
+    stats->largest_free = 0;
+
+    // chunks are sorted by size, with same-sized chunks chained as siblings
+    for (struct equeue_event *es = q->chunks; es; es = es->next) {
+        for (struct equeue_event *e = es; e; e = e->sibling) {
+            stats->free_bytes += e->size;
+        }
+        stats->largest_free = es->size;
+    }
+    equeue_mutex_unlock(&q->memlock);
+}
+
+unsigned equeue_mem_info(equeue_t *q, struct equeue_mem_info *info,
+        struct equeue_mem_chunk *chunks, unsigned count) {
+    unsigned n = 0;
+    equeue_mutex_lock(&q->memlock);
+    info->slab_used = q->slab.data - q->buffer;
+    info->slab_free = q->slab.size;
+    info->size = info->slab_used + info->slab_free;
+    info->free_bytes = 0;
+    info->free_chunks = 0;
+    info->free_sizes = 0;
+    info->largest_free = 0;
+    memcpy(info->requests, q->counters.requests, sizeof(info->requests));
+
+    for (struct equeue_event *es = q->chunks; es; es = es->next) {
+        unsigned siblings = 0;
+        for (struct equeue_event *e = es; e; e = e->sibling) {
+            siblings += 1;
+        }
+
+        if (n < count) {
+            chunks[n].size = es->size;
+            chunks[n].count = siblings;
+            n += 1;
+        }
+
+        info->free_bytes += siblings * es->size;
+        info->free_chunks += siblings;
+        info->free_sizes += 1;
+        info->largest_free = es->size;
+    }
+    equeue_mutex_unlock(&q->memlock);
+
+    // free memory that the largest possible allocation can not reach
+    size_t free = info->free_bytes + info->slab_free;
+    size_t largest = info->largest_free > info->slab_free
+            ? info->largest_free : info->slab_free;
+    info->fragmentation = free ? 100 - (unsigned)(100*largest / free) : 0;
+    return n;
+}
+
+
+// snapshots
+#ifndef EQUEUE_SNAPSHOT_CHUNK
+#define EQUEUE_SNAPSHOT_CHUNK 16
+#endif
+
+unsigned equeue_snapshot(equeue_t *q,
+        struct equeue_snapshot *events, unsigned count) {
+    unsigned n = 0;
+    if (!count) {
+        return 0;
+    }
+
+    equeue_mutex_lock(&q->queuelock);
+    struct equeue_event *es = q->queue;
+    struct equeue_event *e = es;
+
+    // events already copied from the current slot
+    unsigned slot = 0;
+    bool check = false;
+
+    while (true) {
+        for (unsigned chunk = 0; e && n < count &&
+                chunk < EQUEUE_SNAPSHOT_CHUNK; chunk++) {
+            int id = ((unsigned)e->id << q->npw2)
+                    | ((unsigned char *)e - q->buffer);
+
+            bool copied = false;
+            for (unsigned i = slot; check && i < n; i++) {
+                copied = copied || events[i].id == id;
+            }
+
+            if (!copied) {
+                events[n].id = id;
+                events[n].target = e->target;
+                events[n].period = e->period;
+                events[n].cb = e->cb;
+                events[n].size = e->size - sizeof(struct equeue_event);
+                n += 1;
+            }
+
+            if (e->sibling) {
+                e = e->sibling;
+            } else {
+                es = es->next;
+                e = es;
+                slot = n;
+                check = false;
+            }
+        }
+
+        if (!e || n == count) {
+            break;
+        }
+
+        // let producers in between chunks
+        unsigned target = es->target;
+        unsigned updates = q->updates;
+        equeue_mutex_unlock(&q->queuelock);
+        equeue_mutex_lock(&q->queuelock);
+
+        // if the queue changed, find our slot again and skip any events
+        // we have already copied
+        if (q->updates != updates) {
+            es = q->queue;
+            while (es && equeue_tickdiff(es->target, target) < 0) {
+                es = es->next;
+            }
+
+            e = es;
+            if (es && es->target == target) {
+                check = true;
+            } else {
+                slot = n;
+                check = false;
+            }
+        }
+    }
+
+    equeue_mutex_unlock(&q->queuelock);
+    return n;
+}
+
+
+// clocks
+void equeue_clock(equeue_t *q,
+        unsigned (*tick)(void *clock),
+        void (*advance)(void *clock, int ms), void *clock) {
+    equeue_mutex_lock(&q->queuelock);
+    q->clock.tick = tick;
+    q->clock.advance = tick ? advance : 0;
+    q->clock.clock = clock;
+    q->tick = equeue_clock_tick(q);
+    equeue_mutex_unlock(&q->queuelock);
+}
+
+unsigned equeue_now(equeue_t *q) {
+    return equeue_clock_tick(q);
+}
+
+unsigned equeue_vclock_tick(void *clock) {
+    return ((struct equeue_vclock *)clock)->tick;
+}
+
+void equeue_vclock_advance(void *clock, int ms) {
+    ((struct equeue_vclock *)clock)->tick += ms;
+}
+
+
+// recording
+void equeue_recorder(equeue_t *q,
+        void (*record)(void *recorder, const struct equeue_record *r),
+        void *recorder) {
+    equeue_mutex_lock(&q->queuelock);
+    q->recorder.record = record;
+    q->recorder.recorder = recorder;
+    equeue_mutex_unlock(&q->queuelock);
+
+    if (record) {
+        size_t size = (q->slab.data - q->buffer) + q->slab.size;
+        equeue_emit(q, EQUEUE_RECORD_START, 0, 0, size, 0);
+    }
+}
+
+
+// overload policy
+void equeue_overload(equeue_t *q, uint8_t policy) {
+    q->overload = policy;
+}
+
+
+// alerts
+void equeue_alert(equeue_t *q, size_t highwater,
+        void (*alert)(void *data, const struct equeue_alert_info *info),
+        void *data) {
+    equeue_mutex_lock(&q->memlock);
+    q->alert.highwater = highwater;
+    q->alert.high = highwater && q->used >= highwater;
+    q->alert.alert = alert;
+    q->alert.data = data;
+    equeue_mutex_unlock(&q->memlock);
+}
+
+
+// tracing
+#ifdef EQUEUE_TRACE
+unsigned equeue_trace(equeue_t *q,
+        struct equeue_trace_record *buffer, unsigned count) {
+    if (buffer && (!count || (count & (count-1)))) {
+        return 0;
+    }
+
+    // unpublish the old buffer, new writers see no buffer and leave
+    equeue_mutex_lock(&q->queuelock);
+    __atomic_store_n(&q->trace.buffer, 0, __ATOMIC_SEQ_CST);
+    equeue_mutex_unlock(&q->queuelock);
+
+    // wait for writers still holding the old buffer without blocking
+    // producers or dispatch on the queue's lock
+    while (__atomic_load_n(&q->trace.writers, __ATOMIC_SEQ_CST)) {
+    }
+
+    equeue_mutex_lock(&q->queuelock);
+    unsigned head = q->trace.head;
+    q->trace.mask = count - 1;
+    q->trace.head = 0;
+    __atomic_store_n(&q->trace.buffer, buffer, __ATOMIC_SEQ_CST);
+    equeue_mutex_unlock(&q->queuelock);
+
+    return head;
+}
+#endif
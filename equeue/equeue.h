@@ -22,11 +22,16 @@ extern "C" {
 // This size is guaranteed to fit events created by event_call
 #define EQUEUE_EVENT_SIZE (sizeof(struct equeue_event) + 2*sizeof(void*))
 
+// The number of power-of-two buckets in the allocation size histogram
+#define EQUEUE_MEM_BUCKETS 16
+
 // Internal event structure
 struct equeue_event {
     unsigned size;
     uint8_t id;
     uint8_t generation;
+    uint8_t flags;
+    uint8_t priority;
 
     struct equeue_event *next;
     struct equeue_event *sibling;
@@ -40,11 +45,145 @@ struct equeue_event {
     // data follows
 };
 
+// Event flags
+enum {
+    EQUEUE_EVENT_DROPPABLE  = 0x1,
+    EQUEUE_EVENT_PERSISTENT = 0x2,
+    EQUEUE_EVENT_IDLE       = 0x4,
+    EQUEUE_EVENT_REPOST     = 0x8,
+    EQUEUE_EVENT_EXPIRE     = 0x10,
+    EQUEUE_EVENT_RELEASE    = 0x20,
+    EQUEUE_EVENT_WRAPPED    = 0x40,
+};
+
+// Overload policies, see equeue_overload
+enum {
+    EQUEUE_OVERLOAD_DROP_NEW,
+    EQUEUE_OVERLOAD_EVICT_OLDEST,
+    EQUEUE_OVERLOAD_EVICT_LOWEST,
+};
+
+// Recorded operation, see equeue_recorder
+struct equeue_record {
+    uint8_t op;
+    unsigned tick;
+    unsigned offset;
+    int id;
+    int arg;
+    int period;
+};
+
+enum {
+    EQUEUE_RECORD_START,
+    EQUEUE_RECORD_ALLOC,
+    EQUEUE_RECORD_DEALLOC,
+    EQUEUE_RECORD_POST,
+    EQUEUE_RECORD_CANCEL,
+    EQUEUE_RECORD_DISPATCH,
+    EQUEUE_RECORD_REPOST,
+};
+
+// Dispatch hooks, see equeue_hook
+struct equeue_dispatch_info {
+    void *event;
+    void (*cb)(void *);
+    void (*fn)(void *);
+    int id;
+    unsigned target;
+    unsigned start;
+};
+
+struct equeue_hook {
+    void (*pre)(void *data, const struct equeue_dispatch_info *info);
+    void (*post)(void *data, const struct equeue_dispatch_info *info);
+    void *data;
+    struct equeue_hook *next;
+};
+
+// Runtime statistics, see equeue_stats
+struct equeue_stats {
+    unsigned posted;
+    unsigned dispatched;
+    unsigned cancelled;
+    unsigned evicted;
+    unsigned expired;
+    unsigned alloc_failures;
+    unsigned pending;
+    unsigned peak_pending;
+    unsigned passes;
+
+    size_t slab_used;
+    size_t free_bytes;
+    size_t largest_free;
+};
+
+// Allocator alert, see equeue_alert
+struct equeue_alert_info {
+    uint8_t type;
+    size_t size;
+    size_t used;
+    size_t slab_used;
+    size_t slab_free;
+    size_t free_bytes;
+};
+
+enum {
+    EQUEUE_ALERT_ALLOC_FAILURE,
+    EQUEUE_ALERT_HIGHWATER,
+};
+
+// Pending event, see equeue_snapshot
+struct equeue_snapshot {
+    int id;
+    unsigned target;
+    int period;
+    void (*cb)(void *);
+    size_t size;
+};
+
+// Allocator state, see equeue_mem_info
+struct equeue_mem_chunk {
+    size_t size;
+    unsigned count;
+};
+
+struct equeue_mem_info {
+    size_t size;
+    size_t slab_used;
+    size_t slab_free;
+    size_t free_bytes;
+    unsigned free_chunks;
+    unsigned free_sizes;
+    size_t largest_free;
+    unsigned fragmentation;
+    unsigned requests[EQUEUE_MEM_BUCKETS];
+};
+
+#ifdef EQUEUE_TRACE
+// Trace record, see equeue_trace
+struct equeue_trace_record {
+    uint64_t stamp;
+    int id;
+    uint8_t op;
+};
+
+enum {
+    EQUEUE_TRACE_POST,
+    EQUEUE_TRACE_CANCEL,
+    EQUEUE_TRACE_DEQUEUE,
+    EQUEUE_TRACE_START,
+    EQUEUE_TRACE_END,
+    EQUEUE_TRACE_WAIT,
+    EQUEUE_TRACE_WAKE,
+};
+#endif
+
 // Event queue structure
 typedef struct equeue {
     struct equeue_event *queue;
     unsigned tick;
     unsigned breaks;
+    unsigned updates;
     uint8_t generation;
 
     unsigned char *buffer;
@@ -52,6 +191,11 @@ typedef struct equeue {
     void *allocated;
 
     struct equeue_event *chunks;
+    size_t used;
+    unsigned memwaiters;
+    unsigned memstale;
+    unsigned memfrees;
+    uint8_t overload;
     struct equeue_slab {
         size_t size;
         unsigned char *data;
@@ -63,9 +207,57 @@ typedef struct equeue {
         void *timer;
     } background;
 
+    struct equeue_clock {
+        unsigned (*tick)(void *clock);
+        void (*advance)(void *clock, int ms);
+        void *clock;
+    } clock;
+
+    struct equeue_recorder {
+        void (*record)(void *recorder, const struct equeue_record *r);
+        void *recorder;
+    } recorder;
+
+#ifdef EQUEUE_TRACE
+    struct equeue_trace {
+        struct equeue_trace_record *buffer;
+        unsigned mask;
+        unsigned head;
+        unsigned writers;
+    } trace;
+#endif
+
+    struct equeue_hook *hooks;
+    unsigned hookwalks;
+    unsigned hookwaiters;
+
+    struct equeue_alert {
+        size_t highwater;
+        bool high;
+        void (*alert)(void *data, const struct equeue_alert_info *info);
+        void *data;
+    } alert;
+
+    struct equeue_counters {
+        unsigned posted;
+        unsigned cancelled;
+        unsigned evicted;
+        unsigned alloc_failures;
+        unsigned peak;
+        unsigned requests[EQUEUE_MEM_BUCKETS];
+
+        // only written by the dispatching thread, read with relaxed atomics
+        unsigned dispatched;
+        unsigned expired;
+        unsigned completed;
+        unsigned passes;
+    } counters;
+
     equeue_sema_t eventsema;
     equeue_mutex_t queuelock;
     equeue_mutex_t memlock;
+    equeue_sema_t memsema;
+    equeue_sema_t hooksema;
 } equeue_t;
 
 
@@ -135,16 +327,71 @@ int equeue_call_every(equeue_t *queue, int ms, void (*cb)(void *), void *data);
 // and acts as a handle to the underlying event. If there is not enough memory
 // to allocate the event, equeue_alloc returns null.
 void *equeue_alloc(equeue_t *queue, size_t size);
+
+// Allocate memory for events, waiting for memory to become available
+//
+// The equeue_alloc_wait function behaves like equeue_alloc, but if there is
+// not enough memory it blocks until an event is deallocated or dispatched,
+// for up to ms milliseconds, providing backpressure between producers and
+// a slower dispatch loop. A negative ms waits indefinitely and a ms of zero
+// does not wait. On timeout, equeue_alloc_wait returns null.
+//
+// Deallocations only signal the queue when a producer is waiting, so
+// equeue_alloc remains cheap. Unlike equeue_alloc, equeue_alloc_wait is not
+// irq safe, and must not be called from the context dispatching the queue.
+void *equeue_alloc_wait(equeue_t *queue, size_t size, int ms);
 void equeue_dealloc(equeue_t *queue, void *event);
 
+// Allocate memory for events that expire
+//
+// The equeue_alloc_expire function behaves like equeue_alloc, but the
+// event is only dispatched within ms milliseconds of its target. Stale
+// events are dropped without calling the callback and counted in
+// equeue_stats. Periodic events only skip the stale repetition.
+//
+// The window is stored in the event's memory rather than the event
+// header, so only events that expire pay for it. A negative ms allocates
+// an event that never expires, as with equeue_alloc.
+//
+// The equeue_alloc_expire function is irq safe.
+void *equeue_alloc_expire(equeue_t *queue, size_t size, int ms);
+
 // Configure an allocated event
 //
-// equeue_event_delay  - Millisecond delay before dispatching an event
-// equeue_event_period - Millisecond period for repeating dispatching an event
-// equeue_event_dtor   - Destructor to run when the event is deallocated
+// equeue_event_delay     - Millisecond delay before dispatching an event
+// equeue_event_period    - Millisecond period for repeating dispatching an
+//                          event
+// equeue_event_dtor      - Destructor to run when the event is deallocated
+// equeue_event_droppable - Allow the event to be evicted while pending if
+//                          the queue runs out of memory, events with lower
+//                          priority are evicted first, see equeue_overload
+// equeue_event_wrapped   - Mark that the event's memory starts with a pointer
+//                          to the function its callback forwards to, so
+//                          hooks can attribute the event to that function
+//                          rather than to a shared trampoline
 void equeue_event_delay(void *event, int ms);
 void equeue_event_period(void *event, int ms);
 void equeue_event_dtor(void *event, void (*dtor)(void *));
+void equeue_event_droppable(void *event, uint8_t priority);
+void equeue_event_wrapped(void *event);
+
+// Set the overload policy of an event queue
+//
+// The overload policy decides what happens when an allocation fails
+// because the queue is full:
+//
+// EQUEUE_OVERLOAD_DROP_NEW     - The allocation fails, this is the default
+// EQUEUE_OVERLOAD_EVICT_OLDEST - The droppable event with the earliest
+//                                target is evicted
+// EQUEUE_OVERLOAD_EVICT_LOWEST - The droppable event with the lowest
+//                                priority is evicted, ties are broken by
+//                                the earliest target
+//
+// Only pending events marked with equeue_event_droppable that are large
+// enough to satisfy the allocation are evicted. Evicted events have their
+// destructors run in the context of the allocation and are counted in
+// equeue_stats. If no event can be evicted, the allocation fails.
+void equeue_overload(equeue_t *queue, uint8_t policy);
 
 // Post an event onto the event queue
 //
@@ -160,6 +407,55 @@ void equeue_event_dtor(void *event, void (*dtor)(void *));
 // be passed to equeue_cancel.
 int equeue_post(equeue_t *queue, void (*cb)(void *), void *event);
 
+// Post an event unless an identical event is already pending
+//
+// The token is a caller-owned int, initialized to zero, that holds the id
+// of the most recent event posted with it. If that event is still waiting
+// in the queue, equeue_post_unique deallocates the new event and returns
+// the pending event's id, otherwise the new event is posted as with
+// equeue_post and its id is stored in the token. This collapses redundant
+// work, such as flushes requested from many places, in constant time.
+//
+// An event that has started dispatching is no longer pending, so posting
+// from within its callback schedules a new event. equeue_call_unique checks
+// the token before allocating, avoiding allocations for redundant calls.
+//
+// The equeue_pending function returns true if the event with the given id
+// is waiting in the queue, and has not been dispatched or cancelled.
+int equeue_post_unique(equeue_t *queue, int *token,
+        void (*cb)(void *), void *event);
+int equeue_call_unique(equeue_t *queue, int *token,
+        void (*cb)(void *), void *data);
+bool equeue_pending(equeue_t *queue, int id);
+
+// Post or reschedule a persistent event
+//
+// The equeue_repost function schedules an event allocated by equeue_alloc
+// to be dispatched after ms milliseconds. Unlike equeue_post, the event is
+// not deallocated after it is dispatched, and can be reposted any number of
+// times. If the event is still pending, it is moved to its new target in
+// place, without the cancel and allocation churn of equeue_cancel followed
+// by equeue_call_in. Reposting an event while it is being dispatched
+// schedules it again once its callback returns.
+//
+// This provides the building block for debouncing and throttling, where
+// every input pushes back or conditionally schedules a single event.
+//
+// The return value is the unique id of the scheduled event, which changes
+// on every repost. Cancelling a persistent event with equeue_cancel leaves
+// it allocated for reposting. An event passed to equeue_repost must not be
+// passed to equeue_post.
+//
+// The equeue_release function cancels and frees a persistent event in one
+// step. If the event is being dispatched, any repost is dropped and the
+// event is freed once its callback returns, so the event's memory stays
+// valid for the rest of the callback. The event must not be reposted after
+// it is released.
+//
+// The equeue_repost and equeue_release functions are irq safe.
+int equeue_repost(equeue_t *queue, void (*cb)(void *), void *event, int ms);
+void equeue_release(equeue_t *queue, void *event);
+
 // Cancel an in-flight event
 //
 // Attempts to cancel an event referenced by the unique id returned from
@@ -199,6 +495,391 @@ void equeue_background(equeue_t *queue,
 // the context of a dispatch loop while still being managed independently.
 void equeue_chain(equeue_t *queue, equeue_t *target);
 
+// Hook into callback dispatch
+//
+// Registers a hook whose pre and post functions are called immediately
+// before and after each callback dispatched by the queue. Either function
+// may be null. The dispatch info passed to both functions describes the
+// event being dispatched:
+//
+// event  - Pointer to the event's memory, as passed to the callback
+// cb     - The callback being dispatched
+// fn     - The function the callback forwards to, see equeue_event_wrapped,
+//          otherwise the callback itself
+// id     - Unique id of the event
+// target - Tick the event was scheduled for
+// start  - Tick when dispatch of the callback started
+//
+// Hooks are called in the order they were registered, in the context of
+// the dispatch loop. The equeue_hook struct is owned by the caller and
+// linked into the queue, so it must remain valid until equeue_unhook.
+//
+// The dispatch loop takes a snapshot of the hooks for each batch of
+// events it dequeues, so a hook registered or unregistered while callbacks
+// are running either sees both the pre and post of a callback or neither.
+// Both functions wait for the current batch to finish, so once
+// equeue_unhook returns the hook is no longer in use. For this reason,
+// while hooks are registered, equeue_hook and equeue_unhook must not be
+// called from the queue's own callbacks or hooks.
+//
+// With no hooks registered, dispatch only pays for a single branch, and
+// with hooks registered the queue is not locked again per callback.
+void equeue_hook(equeue_t *queue, struct equeue_hook *hook);
+void equeue_unhook(equeue_t *queue, struct equeue_hook *hook);
+
+// Query runtime statistics of an event queue
+//
+// Fills out the provided equeue_stats with counters that are maintained
+// while the queue runs. Counters are updated under locks the queue already
+// takes, or with relaxed loads and stores on the dispatching thread, so
+// they are always enabled.
+//
+// posted         - Events scheduled, including each repeat of periodic events
+// dispatched     - Callbacks executed
+// cancelled      - Events successfully cancelled before dispatch
+// evicted        - Pending events evicted by the overload policy
+// expired        - Events dropped at dispatch for missing their expiry
+// alloc_failures - Allocations that failed due to lack of memory
+// pending        - Events waiting in the queue or being dispatched
+// peak_pending   - Highest number of pending events observed
+// passes         - Iterations of the dispatch loop
+// slab_used      - Bytes of the buffer carved into events so far
+// free_bytes     - Bytes held in freed events available for reuse
+// largest_free   - Size of the largest freed event available for reuse
+//
+// Counters wrap on overflow. Since dispatching may run concurrently, the
+// counters are a snapshot and may be slightly inconsistent with each
+// other. The memory statistics walk the free list and take time
+// proportional to the number of different event sizes.
+void equeue_stats(equeue_t *queue, struct equeue_stats *stats);
+
+// Inspect the allocator of an event queue
+//
+// Fills out the provided equeue_mem_info with the state of the queue's
+// memory, to tell a full queue from a fragmented one and to size buffers
+// from data.
+//
+// size           - Size of the queue's buffer
+// slab_used      - Bytes of the buffer carved into events so far
+// slab_free      - Bytes of the buffer not yet carved into events
+// free_bytes     - Bytes held in freed events available for reuse
+// free_chunks    - Number of freed events available for reuse
+// free_sizes     - Number of distinct sizes of freed events
+// largest_free   - Size of the largest freed event available for reuse
+// fragmentation  - Percentage of free memory, in freed events and the
+//                  slab, that can not be used by the largest possible
+//                  allocation
+// requests       - Histogram of requested allocation sizes, bucket 0
+//                  counts requests up to 8 bytes, bucket n counts requests
+//                  up to 8 << n bytes, and the last bucket counts any larger
+//                  requests
+//
+// Up to count sizes of freed events are written to chunks in increasing
+// order of size, along with the number of freed events of each size.
+// Sizes include the event overhead. The chunks may be null if count is
+// zero. equeue_mem_info returns the number of sizes written.
+unsigned equeue_mem_info(equeue_t *queue, struct equeue_mem_info *info,
+        struct equeue_mem_chunk *chunks, unsigned count);
+
+// Alert on allocation failures and high memory usage
+//
+// The provided alert function is called whenever an allocation fails, and
+// when the bytes used by allocated events first reach the highwater mark.
+// The high-water alert is rearmed once usage drops back below the mark. A
+// highwater of zero only alerts on allocation failures.
+//
+// The alert function is called from the context that allocated the event,
+// which may be an irq, after the queue's locks are released. It is passed
+// the alert type, the requested size, and a breakdown of the queue's
+// memory at the time of the allocation:
+//
+// used       - Bytes in allocated events, including event overhead
+// slab_used  - Bytes of the buffer carved into events so far
+// slab_free  - Bytes of the buffer not yet carved into events
+// free_bytes - Bytes held in freed events available for reuse
+//
+// Further detail can be queried with equeue_mem_info from within the alert.
+// Passing a null alert function disables alerts.
+void equeue_alert(equeue_t *queue, size_t highwater,
+        void (*alert)(void *data, const struct equeue_alert_info *info),
+        void *data);
+
+// Take a snapshot of the pending events in an event queue
+//
+// Copies the id, target tick, period, callback and size of up to count
+// pending events into the provided array, in the order they will be
+// dispatched, and returns the number of events copied.
+//
+// The queue lock is only held while copying a small chunk of events at a
+// time, so producers are not stalled by large queues. As a consequence
+// the snapshot is not atomic. Events that remain pending for the duration
+// of the snapshot are reported exactly once, while events posted or
+// cancelled during the snapshot may or may not be reported. Events being
+// dispatched are no longer pending and are not reported.
+unsigned equeue_snapshot(equeue_t *queue,
+        struct equeue_snapshot *events, unsigned count);
+
+// Provide a clock for an event queue
+//
+// The provided tick function replaces equeue_tick as the source of time for
+// this queue. If an advance function is also provided, equeue_dispatch
+// calls it instead of waiting whenever it is idle until a finite deadline,
+// passing the milliseconds until the next event or the end of dispatch.
+//
+// Passing a null tick function restores the platform tick.
+//
+// The clock should be provided before any events are posted, since pending
+// events are scheduled relative to the previous clock. Chained queues must
+// share the same clock.
+//
+// The equeue_now function returns the current tick of the queue's clock,
+// the time base that event delays are measured against.
+void equeue_clock(equeue_t *queue,
+        unsigned (*tick)(void *clock),
+        void (*advance)(void *clock, int ms), void *clock);
+unsigned equeue_now(equeue_t *queue);
+
+// Virtual clock
+//
+// A clock that only moves when advanced. Passing equeue_vclock_tick and
+// equeue_vclock_advance to equeue_clock lets equeue_dispatch jump straight
+// to the next deadline, running timer workloads faster than real time
+// while keeping their order and timing deterministic.
+//
+// The virtual clock is not thread safe, events must only be posted from
+// the dispatching thread or while the queue is not being dispatched.
+struct equeue_vclock {
+    unsigned tick;
+};
+
+unsigned equeue_vclock_tick(void *clock);
+void equeue_vclock_advance(void *clock, int ms);
+
+// Record operations on an event queue
+//
+// The provided record function is called with a fixed-size record for
+// every alloc, dealloc, post, repost, cancel and dispatch on the queue,
+// allowing the operation stream to be logged and later replayed with
+// tests/replay.
+// The record function may be called from any context that uses the queue,
+// including irqs, and must be safe in those contexts. Posts are recorded
+// while the queue is locked, so a post is always recorded before its
+// dispatch, and the record function must not call back into the queue.
+//
+// Each record contains the operation, the tick of the queue's clock, and
+// the offset of the event in the queue's buffer, which identifies an event
+// from alloc through to dealloc. Other fields depend on the operation:
+//
+// EQUEUE_RECORD_START    - arg is the size of the queue's buffer
+// EQUEUE_RECORD_ALLOC    - arg is the requested size, period is the expiry
+//                          window or -1, offset is -1 if the allocation
+//                          failed
+// EQUEUE_RECORD_DEALLOC  - offset of the deallocated event
+// EQUEUE_RECORD_POST     - id of the posted event, arg is the delay, period
+//                          is the period
+// EQUEUE_RECORD_CANCEL   - id of the cancelled event
+// EQUEUE_RECORD_DISPATCH - id of the dispatched event
+// EQUEUE_RECORD_REPOST   - id of the reposted event, arg is the delay
+//
+// Persistent events are allocated once and may be reposted many times, so
+// replays keep them from alloc until their dealloc record, which for
+// released events is only emitted once the event is actually freed.
+//
+// A start record is emitted when the recorder is attached. For replays to
+// be faithful, the recorder should be attached before the queue is used.
+//
+// Passing a null record function detaches the recorder.
+void equeue_recorder(equeue_t *queue,
+        void (*record)(void *recorder, const struct equeue_record *r),
+        void *recorder);
+
+
+#if defined(EQUEUE_PLATFORM_POSIX)
+// Watch for long-running callbacks
+//
+// Attaches a watchdog to an event queue that reports any callback that
+// runs longer than the budget in milliseconds. The watchdog is built on
+// dispatch hooks and a side thread, so it only detects overruns and does
+// not interrupt the callback. The side thread sleeps until the running
+// callback's budget runs out and is only signalled when a callback starts
+// while it is idle, so busy queues don't wake it for every callback.
+//
+// The report function is called from the watchdog thread with finished set
+// to false as soon as a callback exceeds its budget, and again from the
+// dispatch context with finished set to true and the total duration once
+// the callback returns. If report is null, overruns are printed to stderr,
+// including the callback's symbol name where it can be resolved.
+//
+// If the watchdog creation fails, equeue_watchdog_create returns a
+// negative, platform-specific error code.
+typedef struct equeue_watchdog {
+    equeue_t *q;
+    int budget;
+    void (*report)(void *data, void (*cb)(void *), int ms, bool finished);
+    void *data;
+
+    struct equeue_hook hook;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool running;
+    bool active;
+    bool reported;
+    bool waiting;
+    void (*cb)(void *);
+    struct timespec start;
+} equeue_watchdog_t;
+
+int equeue_watchdog_create(equeue_watchdog_t *watchdog,
+        equeue_t *queue, int budget,
+        void (*report)(void *data, void (*cb)(void *), int ms, bool finished),
+        void *data);
+void equeue_watchdog_destroy(equeue_watchdog_t *watchdog);
+
+// Profile the time spent in each callback
+//
+// Attaches a profiler to an event queue that aggregates the invocation
+// count, total and max wall time, and the dispatching thread's CPU time for
+// each distinct function. Events posted with equeue_call and its variants,
+// or with EventQueue::call and a function pointer, are keyed on the
+// function they forward to rather than on the shared trampoline, other
+// events are keyed on their callback.
+//
+// The profiler uses the provided array of profiles as an open-addressed
+// table, callbacks that do not fit are counted as dropped. The profiler
+// assumes a single thread dispatches the queue, but may be dumped from any
+// thread.
+//
+// equeue_profiler_dump calls the dump function with each callback's
+// profile, in no particular order. If dump is null, the profiles are
+// printed to stderr, including the callback's symbol name where it can be
+// resolved.
+//
+// If the profiler creation fails, equeue_profiler_create returns a
+// negative, platform-specific error code.
+struct equeue_profile {
+    void (*cb)(void *);
+    unsigned count;
+    uint64_t wall_ns;
+    uint64_t max_ns;
+    uint64_t cpu_ns;
+};
+
+typedef struct equeue_profiler {
+    equeue_t *q;
+    struct equeue_profile *profiles;
+    unsigned size;
+    unsigned dropped;
+
+    struct equeue_hook hook;
+    pthread_mutex_t lock;
+    struct timespec wall;
+    struct timespec cpu;
+} equeue_profiler_t;
+
+int equeue_profiler_create(equeue_profiler_t *profiler, equeue_t *queue,
+        struct equeue_profile *profiles, unsigned count);
+void equeue_profiler_destroy(equeue_profiler_t *profiler);
+void equeue_profiler_reset(equeue_profiler_t *profiler);
+void equeue_profiler_dump(equeue_profiler_t *profiler,
+        void (*dump)(void *data, const struct equeue_profile *profile),
+        void *data);
+
+// Export statistics in the Prometheus text format
+//
+// An exporter collects the statistics of any number of registered queues,
+// along with a histogram of each queue's dispatch lag, the time between an
+// event's target tick and the start of its callback. Each queue is
+// registered with a caller-provided equeue_export and a name used as the
+// queue label.
+//
+// equeue_exporter_format formats the metrics into the buffer, and returns
+// the length of the metrics in the same manner as snprintf.
+// equeue_exporter_write atomically replaces the file at path with the
+// metrics, suitable for textfile collectors. equeue_exporter_listen serves
+// the metrics over HTTP on a Unix domain socket at path from a side thread
+// until the exporter is destroyed. Clients are served one at a time, and a
+// client that stalls is dropped after EQUEUE_EXPORT_TIMEOUT milliseconds,
+// or as soon as the exporter is destroyed.
+//
+// If an operation fails, the exporter functions return a negative,
+// platform-specific error code.
+#define EQUEUE_EXPORT_BUCKETS 11
+#ifndef EQUEUE_EXPORT_TIMEOUT
+#define EQUEUE_EXPORT_TIMEOUT 1000
+#endif
+
+struct equeue_export {
+    equeue_t *q;
+    const char *name;
+    struct equeue_hook hook;
+    unsigned lag[EQUEUE_EXPORT_BUCKETS+1];
+    uint64_t lag_sum;
+    struct equeue_export *next;
+
+    // snapshot taken by each scrape
+    struct equeue_stats stats;
+    unsigned lags[EQUEUE_EXPORT_BUCKETS+1];
+    uint64_t lags_sum;
+};
+
+typedef struct equeue_exporter {
+    struct equeue_export *exports;
+    pthread_mutex_t lock;
+    pthread_t thread;
+    int fd;
+    int client;
+    bool closing;
+    char path[108];
+} equeue_exporter_t;
+
+int equeue_exporter_create(equeue_exporter_t *exporter);
+void equeue_exporter_destroy(equeue_exporter_t *exporter);
+void equeue_exporter_add(equeue_exporter_t *exporter,
+        struct equeue_export *entry, equeue_t *queue, const char *name);
+void equeue_exporter_remove(equeue_exporter_t *exporter,
+        struct equeue_export *entry);
+int equeue_exporter_format(equeue_exporter_t *exporter,
+        char *buffer, size_t size);
+int equeue_exporter_write(equeue_exporter_t *exporter, const char *path);
+int equeue_exporter_listen(equeue_exporter_t *exporter, const char *path);
+#endif
+
+#ifdef EQUEUE_TRACE
+// Trace an event queue into a ring buffer
+//
+// When compiled with EQUEUE_TRACE, both the library and users of equeue.h,
+// the event queue can record a timestamped trace of its operation into a
+// user provided ring of records. The count must be a power of two, and
+// once full the oldest records are overwritten. Records are claimed
+// without locks, so tracing is cheap enough to leave running. If count is
+// not a power of two, the buffer is rejected, the current trace is left
+// untouched and equeue_trace returns 0.
+//
+// Each record holds a timestamp from the cpu's cycle counter where one is
+// available, the operation, and an id:
+//
+// EQUEUE_TRACE_POST    - id of the posted event
+// EQUEUE_TRACE_CANCEL  - id of the event being cancelled
+// EQUEUE_TRACE_DEQUEUE - tick of the queue, for relating stamps to time
+// EQUEUE_TRACE_START   - id of the event whose callback is starting
+// EQUEUE_TRACE_END     - id of the event whose callback has finished
+// EQUEUE_TRACE_WAIT    - dispatch is idle, waiting for events
+// EQUEUE_TRACE_WAKE    - dispatch has woken up
+//
+// Records are written to buffer[n % count], where n counts every record
+// written since the buffer was attached. Passing a null buffer detaches
+// the current buffer, and equeue_trace returns n for the previously
+// attached buffer so the ring can be read in order. Attaching or
+// detaching waits for records being written to the previous buffer, so
+// once equeue_trace returns the previous buffer may be read or reused.
+// The wait does not hold the queue's lock, so equeue_trace should not be
+// called from multiple threads at once.
+// tests/trace converts rings to Chrome trace JSON.
+unsigned equeue_trace(equeue_t *queue,
+        struct equeue_trace_record *buffer, unsigned count);
+#endif
+
 
 #ifdef __cplusplus
 }
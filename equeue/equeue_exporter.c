@@ -0,0 +1,415 @@
+/*
+ * Prometheus exporter on Posix compliant platforms
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#define _GNU_SOURCE
+#include "equeue.h"
+
+#if defined(EQUEUE_PLATFORM_POSIX)
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+
+// Upper bounds of the dispatch lag buckets in milliseconds
+static const unsigned equeue_export_bounds[EQUEUE_EXPORT_BUCKETS] = {
+    0, 1, 2, 5, 10, 25, 50, 100, 250, 500, 1000,
+};
+
+// Dispatch hook, the histogram is read by scrapers so it is updated with
+// relaxed atomics
+static void equeue_export_pre(void *data,
+        const struct equeue_dispatch_info *info) {
+    struct equeue_export *x = (struct equeue_export *)data;
+    int lag = (int)(info->start - info->target);
+    if (lag < 0) {
+        lag = 0;
+    }
+
+    unsigned i = 0;
+    while (i < EQUEUE_EXPORT_BUCKETS &&
+            (unsigned)lag > equeue_export_bounds[i]) {
+        i++;
+    }
+
+    __atomic_fetch_add(&x->lag[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&x->lag_sum, (uint64_t)lag, __ATOMIC_RELAXED);
+}
+
+
+// Registration of queues
+int equeue_exporter_create(equeue_exporter_t *x) {
+    x->exports = 0;
+    x->fd = -1;
+    x->client = -1;
+    x->closing = false;
+    x->path[0] = '\0';
+
+    int err = pthread_mutex_init(&x->lock, 0);
+    if (err) {
+        return -err;
+    }
+
+    return 0;
+}
+
+void equeue_exporter_destroy(equeue_exporter_t *x) {
+    // shutting down the sockets wakes up the listening thread, whether it
+    // is waiting for a client or on one
+    if (x->fd >= 0) {
+        pthread_mutex_lock(&x->lock);
+        x->closing = true;
+        if (x->client >= 0) {
+            shutdown(x->client, SHUT_RDWR);
+        }
+        pthread_mutex_unlock(&x->lock);
+
+        shutdown(x->fd, SHUT_RDWR);
+        pthread_join(x->thread, 0);
+        close(x->fd);
+        unlink(x->path);
+    }
+
+    while (x->exports) {
+        equeue_exporter_remove(x, x->exports);
+    }
+
+    pthread_mutex_destroy(&x->lock);
+}
+
+void equeue_exporter_add(equeue_exporter_t *x,
+        struct equeue_export *entry, equeue_t *q, const char *name) {
+    memset(entry, 0, sizeof(struct equeue_export));
+    entry->q = q;
+    entry->name = name;
+    entry->hook.pre = equeue_export_pre;
+    entry->hook.data = entry;
+    equeue_hook(q, &entry->hook);
+
+    pthread_mutex_lock(&x->lock);
+    struct equeue_export **p = &x->exports;
+    while (*p) {
+        p = &(*p)->next;
+    }
+    *p = entry;
+    pthread_mutex_unlock(&x->lock);
+}
+
+void equeue_exporter_remove(equeue_exporter_t *x,
+        struct equeue_export *entry) {
+    pthread_mutex_lock(&x->lock);
+    for (struct equeue_export **p = &x->exports; *p; p = &(*p)->next) {
+        if (*p == entry) {
+            *p = entry->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&x->lock);
+
+    equeue_unhook(entry->q, &entry->hook);
+}
+
+
+// Formatting, in the manner of snprintf
+struct equeue_export_buffer {
+    char *data;
+    size_t size;
+    size_t len;
+};
+
+static void equeue_export_printf(struct equeue_export_buffer *b,
+        const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    size_t left = b->len < b->size ? b->size - b->len : 0;
+    int len = vsnprintf(left ? b->data + b->len : 0, left, fmt, args);
+    va_end(args);
+
+    if (len > 0) {
+        b->len += len;
+    }
+}
+
+// A statistic exported as a metric, with the offset and size of its field
+// in equeue_stats
+struct equeue_export_metric {
+    const char *metric;
+    const char *type;
+    const char *help;
+    size_t offset;
+    size_t size;
+};
+
+#define EQUEUE_EXPORT_FIELD(field) \
+    offsetof(struct equeue_stats, field), \
+    sizeof(((struct equeue_stats *)0)->field)
+
+static void equeue_export_metric(struct equeue_export_buffer *b,
+        equeue_exporter_t *x, const struct equeue_export_metric *m) {
+    equeue_export_printf(b, "# HELP equeue_%s %s\n", m->metric, m->help);
+    equeue_export_printf(b, "# TYPE equeue_%s %s\n", m->metric, m->type);
+
+    for (struct equeue_export *e = x->exports; e; e = e->next) {
+        const unsigned char *field = (const unsigned char *)&e->stats
+                + m->offset;
+        uint64_t value = (m->size == sizeof(uint64_t))
+                ? *(const uint64_t *)field
+                : *(const uint32_t *)field;
+
+        equeue_export_printf(b, "equeue_%s{queue=\"%s\"} %" PRIu64 "\n",
+                m->metric, e->name, value);
+    }
+}
+
+int equeue_exporter_format(equeue_exporter_t *x, char *buffer, size_t size) {
+    struct equeue_export_buffer b = {buffer, size, 0};
+    if (size) {
+        buffer[0] = '\0';
+    }
+
+    static const struct equeue_export_metric metrics[] = {
+        {"events_posted_total", "counter", "Events scheduled.",
+            EQUEUE_EXPORT_FIELD(posted)},
+        {"events_dispatched_total", "counter", "Callbacks executed.",
+            EQUEUE_EXPORT_FIELD(dispatched)},
+        {"events_cancelled_total", "counter", "Events cancelled.",
+            EQUEUE_EXPORT_FIELD(cancelled)},
+        {"events_evicted_total", "counter", "Events evicted on overload.",
+            EQUEUE_EXPORT_FIELD(evicted)},
+        {"events_expired_total", "counter", "Events dropped as stale.",
+            EQUEUE_EXPORT_FIELD(expired)},
+        {"alloc_failures_total", "counter", "Failed allocations.",
+            EQUEUE_EXPORT_FIELD(alloc_failures)},
+        {"dispatch_passes_total", "counter", "Dispatch loop iterations.",
+            EQUEUE_EXPORT_FIELD(passes)},
+        {"events_pending", "gauge", "Events waiting or being dispatched.",
+            EQUEUE_EXPORT_FIELD(pending)},
+        {"events_pending_peak", "gauge", "Highest number of pending events.",
+            EQUEUE_EXPORT_FIELD(peak_pending)},
+        {"slab_used_bytes", "gauge", "Bytes carved into events.",
+            EQUEUE_EXPORT_FIELD(slab_used)},
+        {"free_bytes", "gauge", "Bytes in freed events.",
+            EQUEUE_EXPORT_FIELD(free_bytes)},
+    };
+
+    pthread_mutex_lock(&x->lock);
+
+    // take one snapshot of each queue so every metric in a scrape comes
+    // from the same moment
+    for (struct equeue_export *e = x->exports; e; e = e->next) {
+        equeue_stats(e->q, &e->stats);
+        for (unsigned i = 0; i <= EQUEUE_EXPORT_BUCKETS; i++) {
+            e->lags[i] = __atomic_load_n(&e->lag[i], __ATOMIC_RELAXED);
+        }
+        e->lags_sum = __atomic_load_n(&e->lag_sum, __ATOMIC_RELAXED);
+    }
+
+    for (size_t i = 0; i < sizeof(metrics)/sizeof(metrics[0]); i++) {
+        equeue_export_metric(&b, x, &metrics[i]);
+    }
+
+    equeue_export_printf(&b, "# HELP equeue_dispatch_lag_milliseconds "
+            "Delay between an event's target and its dispatch.\n");
+    equeue_export_printf(&b, "# TYPE equeue_dispatch_lag_milliseconds "
+            "histogram\n");
+    for (struct equeue_export *e = x->exports; e; e = e->next) {
+        uint64_t count = 0;
+        for (unsigned i = 0; i <= EQUEUE_EXPORT_BUCKETS; i++) {
+            count += e->lags[i];
+            if (i < EQUEUE_EXPORT_BUCKETS) {
+                equeue_export_printf(&b, "equeue_dispatch_lag_milliseconds_"
+                        "bucket{queue=\"%s\",le=\"%u\"} %" PRIu64 "\n",
+                        e->name, equeue_export_bounds[i], count);
+            } else {
+                equeue_export_printf(&b, "equeue_dispatch_lag_milliseconds_"
+                        "bucket{queue=\"%s\",le=\"+Inf\"} %" PRIu64 "\n",
+                        e->name, count);
+            }
+        }
+
+        equeue_export_printf(&b, "equeue_dispatch_lag_milliseconds_sum"
+                "{queue=\"%s\"} %" PRIu64 "\n", e->name, e->lags_sum);
+        equeue_export_printf(&b, "equeue_dispatch_lag_milliseconds_count"
+                "{queue=\"%s\"} %" PRIu64 "\n", e->name, count);
+    }
+    pthread_mutex_unlock(&x->lock);
+
+    return b.len;
+}
+
+static char *equeue_export_alloc(equeue_exporter_t *x, int *len) {
+    // metrics may grow between sizing and formatting, so retry
+    int size = 0;
+    char *buffer = 0;
+    while (true) {
+        *len = equeue_exporter_format(x, buffer, size);
+        if (buffer && *len < size) {
+            return buffer;
+        }
+
+        free(buffer);
+        size = *len + 256;
+        buffer = malloc(size);
+        if (!buffer) {
+            return 0;
+        }
+    }
+}
+
+
+// Textfile export
+int equeue_exporter_write(equeue_exporter_t *x, const char *path) {
+    int len;
+    char *buffer = equeue_export_alloc(x, &len);
+    if (!buffer) {
+        return -ENOMEM;
+    }
+
+    // write to a temporary file and rename so readers see whole files
+    char tmp[strlen(path) + 8];
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(buffer);
+        return -errno;
+    }
+
+    int err = 0;
+    if (write(fd, buffer, len) != len || fchmod(fd, 0644) < 0) {
+        err = -errno;
+    }
+    close(fd);
+    free(buffer);
+
+    if (!err && rename(tmp, path) < 0) {
+        err = -errno;
+    }
+
+    if (err) {
+        unlink(tmp);
+    }
+    return err;
+}
+
+
+// HTTP over a Unix domain socket
+static void equeue_export_send(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t res = send(fd, data, len, MSG_NOSIGNAL);
+        if (res <= 0) {
+            return;
+        }
+
+        data += res;
+        len -= res;
+    }
+}
+
+static void *equeue_export_thread(void *p) {
+    equeue_exporter_t *x = (equeue_exporter_t *)p;
+
+    while (true) {
+        int client = accept(x->fd, 0, 0);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return 0;
+        }
+
+        // bound how long a stalled client can hold up later scrapes, and
+        // publish the client so destroy can interrupt it
+        struct timeval timeout = {
+            EQUEUE_EXPORT_TIMEOUT / 1000,
+            (EQUEUE_EXPORT_TIMEOUT % 1000) * 1000,
+        };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO,
+                &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO,
+                &timeout, sizeof(timeout));
+
+        pthread_mutex_lock(&x->lock);
+        bool closing = x->closing;
+        if (!closing) {
+            x->client = client;
+        }
+        pthread_mutex_unlock(&x->lock);
+
+        if (closing) {
+            close(client);
+            return 0;
+        }
+
+        // the request is read but ignored, every path serves the metrics
+        char request[512];
+        recv(client, request, sizeof(request), 0);
+
+        int len;
+        char *buffer = equeue_export_alloc(x, &len);
+        if (buffer) {
+            char header[128];
+            int hlen = snprintf(header, sizeof(header),
+                    "HTTP/1.0 200 OK\r\n"
+                    "Content-Type: text/plain; version=0.0.4\r\n"
+                    "Content-Length: %d\r\n\r\n", len);
+            equeue_export_send(client, header, hlen);
+            equeue_export_send(client, buffer, len);
+            free(buffer);
+        }
+
+        pthread_mutex_lock(&x->lock);
+        x->client = -1;
+        pthread_mutex_unlock(&x->lock);
+        close(client);
+    }
+}
+
+int equeue_exporter_listen(equeue_exporter_t *x, const char *path) {
+    struct sockaddr_un addr;
+    if (x->fd >= 0 || strlen(path) >= sizeof(addr.sun_path)) {
+        return -EINVAL;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+            listen(fd, 8) < 0) {
+        int err = -errno;
+        close(fd);
+        return err;
+    }
+
+    strcpy(x->path, path);
+    x->fd = fd;
+
+    int err = pthread_create(&x->thread, 0, equeue_export_thread, x);
+    if (err) {
+        close(fd);
+        unlink(path);
+        x->fd = -1;
+        return -err;
+    }
+
+    return 0;
+}
+
+#endif
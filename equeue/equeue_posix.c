@@ -78,9 +78,14 @@ bool equeue_sema_wait(equeue_sema_t *s, int ms) {
 
             struct timespec ts = {
                 .tv_sec = ms/1000 + tv.tv_sec,
-                .tv_nsec = ms*1000000 + tv.tv_usec*1000,
+                .tv_nsec = (ms%1000)*1000000 + tv.tv_usec*1000,
             };
 
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec += 1;
+                ts.tv_nsec -= 1000000000;
+            }
+
             pthread_cond_timedwait(&s->cond, &s->mutex, &ts);
         }
     }
@@ -0,0 +1,162 @@
+/*
+ * Per-callback profiler on Posix compliant platforms
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#define _GNU_SOURCE
+#include "equeue.h"
+
+#if defined(EQUEUE_PLATFORM_POSIX)
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <dlfcn.h>
+#endif
+
+
+static uint64_t equeue_profiler_ns(const struct timespec *start,
+        const struct timespec *end) {
+    return (uint64_t)(end->tv_sec - start->tv_sec)*1000000000
+            + (end->tv_nsec - start->tv_nsec);
+}
+
+// Finds or claims the profile for a callback, linear probing from a
+// hash of the callback's address
+static struct equeue_profile *equeue_profiler_find(
+        equeue_profiler_t *p, void (*cb)(void *)) {
+    uintptr_t key = (uintptr_t)*(void **)&cb;
+    unsigned i = (unsigned)((key >> 2) * 2654435761u) % p->size;
+
+    for (unsigned n = 0; n < p->size; n++) {
+        struct equeue_profile *profile = &p->profiles[i];
+        if (profile->cb == cb) {
+            return profile;
+        } else if (!profile->cb) {
+            profile->cb = cb;
+            return profile;
+        }
+
+        i = (i + 1) % p->size;
+    }
+
+    return 0;
+}
+
+
+// Dispatch hooks, timing each callback
+static void equeue_profiler_pre(void *data,
+        const struct equeue_dispatch_info *info) {
+    equeue_profiler_t *p = (equeue_profiler_t *)data;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &p->cpu);
+    clock_gettime(CLOCK_MONOTONIC, &p->wall);
+}
+
+static void equeue_profiler_post(void *data,
+        const struct equeue_dispatch_info *info) {
+    equeue_profiler_t *p = (equeue_profiler_t *)data;
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+
+    uint64_t wall_ns = equeue_profiler_ns(&p->wall, &wall);
+    uint64_t cpu_ns = equeue_profiler_ns(&p->cpu, &cpu);
+
+    pthread_mutex_lock(&p->lock);
+    struct equeue_profile *profile = equeue_profiler_find(p, info->fn);
+    if (profile) {
+        profile->count += 1;
+        profile->wall_ns += wall_ns;
+        profile->cpu_ns += cpu_ns;
+        if (wall_ns > profile->max_ns) {
+            profile->max_ns = wall_ns;
+        }
+    } else {
+        p->dropped += 1;
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+
+// Profiler lifetime
+int equeue_profiler_create(equeue_profiler_t *p, equeue_t *q,
+        struct equeue_profile *profiles, unsigned count) {
+    p->q = q;
+    p->profiles = profiles;
+    p->size = count;
+    p->dropped = 0;
+    memset(profiles, 0, count*sizeof(struct equeue_profile));
+
+    int err = pthread_mutex_init(&p->lock, 0);
+    if (err) {
+        return -err;
+    }
+
+    p->hook.pre = equeue_profiler_pre;
+    p->hook.post = equeue_profiler_post;
+    p->hook.data = p;
+    equeue_hook(q, &p->hook);
+    return 0;
+}
+
+void equeue_profiler_destroy(equeue_profiler_t *p) {
+    equeue_unhook(p->q, &p->hook);
+    pthread_mutex_destroy(&p->lock);
+}
+
+void equeue_profiler_reset(equeue_profiler_t *p) {
+    pthread_mutex_lock(&p->lock);
+    memset(p->profiles, 0, p->size*sizeof(struct equeue_profile));
+    p->dropped = 0;
+    pthread_mutex_unlock(&p->lock);
+}
+
+
+// Default dump, resolving the callback's symbol where possible
+static void equeue_profiler_print(void *data,
+        const struct equeue_profile *profile) {
+    void (*cb)(void *) = profile->cb;
+    const char *name = "?";
+#if defined(__GLIBC__) || defined(__APPLE__)
+    Dl_info info;
+    if (dladdr(*(void **)&cb, &info) && info.dli_sname) {
+        name = info.dli_sname;
+    }
+#endif
+
+    fprintf(stderr, "%-18p %-32s %10u %12.3f %12.3f %12.3f\n",
+            *(void **)&cb, name, profile->count,
+            profile->wall_ns / 1e6, profile->max_ns / 1e6,
+            profile->cpu_ns / 1e6);
+}
+
+void equeue_profiler_dump(equeue_profiler_t *p,
+        void (*dump)(void *data, const struct equeue_profile *profile),
+        void *data) {
+    if (!dump) {
+        fprintf(stderr, "%-18s %-32s %10s %12s %12s %12s\n",
+                "callback", "symbol", "count",
+                "wall (ms)", "max (ms)", "cpu (ms)");
+        dump = equeue_profiler_print;
+    }
+
+    // dump from a snapshot so slow dump functions don't stall dispatch
+    for (unsigned i = 0; i < p->size; i++) {
+        pthread_mutex_lock(&p->lock);
+        struct equeue_profile profile = p->profiles[i];
+        pthread_mutex_unlock(&p->lock);
+
+        if (profile.cb) {
+            dump(data, &profile);
+        }
+    }
+
+    if (p->dropped && dump == equeue_profiler_print) {
+        fprintf(stderr, "%u callbacks dropped\n", p->dropped);
+    }
+}
+
+#endif
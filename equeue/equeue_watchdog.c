@@ -0,0 +1,198 @@
+/*
+ * Watchdog for long-running callbacks on Posix compliant platforms
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#define _GNU_SOURCE
+#define _DARWIN_C_SOURCE
+#include "equeue.h"
+
+#if defined(EQUEUE_PLATFORM_POSIX)
+
+#include <stdio.h>
+#include <time.h>
+#if defined(__GLIBC__) || defined(__APPLE__)
+#include <dlfcn.h>
+#endif
+
+
+// Time helpers on the monotonic clock
+static int equeue_watchdog_elapsed(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec)*1000
+            + (now.tv_nsec - start->tv_nsec)/1000000;
+}
+
+static struct timespec equeue_watchdog_deadline(
+        const struct timespec *start, int ms) {
+    struct timespec ts = {
+        .tv_sec = start->tv_sec + ms/1000,
+        .tv_nsec = start->tv_nsec + (ms%1000)*1000000,
+    };
+
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec += 1;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    return ts;
+}
+
+
+// Default report, resolving the callback's symbol where possible
+static void equeue_watchdog_print(void *data, void (*cb)(void *),
+        int ms, bool finished) {
+    const char *name = "?";
+#if defined(__GLIBC__) || defined(__APPLE__)
+    Dl_info info;
+    if (dladdr(*(void **)&cb, &info) && info.dli_sname) {
+        name = info.dli_sname;
+    }
+#endif
+
+    fprintf(stderr, "equeue watchdog: callback %p (%s) %s %d ms\n",
+            *(void **)&cb, name,
+            finished ? "finished after" : "running for", ms);
+}
+
+
+// Dispatch hooks, timing each callback
+static void equeue_watchdog_pre(void *p,
+        const struct equeue_dispatch_info *info) {
+    equeue_watchdog_t *w = (equeue_watchdog_t *)p;
+    pthread_mutex_lock(&w->lock);
+    clock_gettime(CLOCK_MONOTONIC, &w->start);
+    w->cb = info->cb;
+    w->active = true;
+    w->reported = false;
+
+    // the thread only needs waking if it is idle, otherwise it picks up
+    // this callback when its current deadline passes
+    if (w->waiting) {
+        pthread_cond_signal(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void equeue_watchdog_post(void *p,
+        const struct equeue_dispatch_info *info) {
+    equeue_watchdog_t *w = (equeue_watchdog_t *)p;
+    pthread_mutex_lock(&w->lock);
+    w->active = false;
+    bool reported = w->reported;
+    int ms = equeue_watchdog_elapsed(&w->start);
+    pthread_mutex_unlock(&w->lock);
+
+    if (reported) {
+        w->report(w->data, info->cb, ms, true);
+    }
+}
+
+// Side thread, sleeps until the active callback's budget runs out, and
+// checks whichever callback is running when it wakes up
+static void *equeue_watchdog_thread(void *p) {
+    equeue_watchdog_t *w = (equeue_watchdog_t *)p;
+    pthread_mutex_lock(&w->lock);
+
+    while (w->running) {
+        if (!w->active || w->reported) {
+            w->waiting = true;
+            pthread_cond_wait(&w->cond, &w->lock);
+            w->waiting = false;
+            continue;
+        }
+
+        // current callback past its budget?
+        int ms = equeue_watchdog_elapsed(&w->start);
+        if (ms >= w->budget) {
+            w->reported = true;
+            void (*cb)(void *) = w->cb;
+
+            pthread_mutex_unlock(&w->lock);
+            w->report(w->data, cb, ms, false);
+            pthread_mutex_lock(&w->lock);
+            continue;
+        }
+
+#if defined(__APPLE__)
+        // no pthread_condattr_setclock, so wait relative to now
+        static const struct timespec zero = {0, 0};
+        struct timespec timeout = equeue_watchdog_deadline(
+                &zero, w->budget - ms);
+        pthread_cond_timedwait_relative_np(&w->cond, &w->lock, &timeout);
+#else
+        struct timespec deadline = equeue_watchdog_deadline(
+                &w->start, w->budget);
+        pthread_cond_timedwait(&w->cond, &w->lock, &deadline);
+#endif
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+
+// Watchdog lifetime
+int equeue_watchdog_create(equeue_watchdog_t *w,
+        equeue_t *q, int budget,
+        void (*report)(void *data, void (*cb)(void *), int ms, bool finished),
+        void *data) {
+    w->q = q;
+    w->budget = budget;
+    w->report = report ? report : equeue_watchdog_print;
+    w->data = data;
+    w->running = true;
+    w->active = false;
+    w->reported = false;
+    w->waiting = false;
+    w->cb = 0;
+
+    int err = pthread_mutex_init(&w->lock, 0);
+    if (err) {
+        return -err;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+#if !defined(__APPLE__)
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+#endif
+    err = pthread_cond_init(&w->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (err) {
+        pthread_mutex_destroy(&w->lock);
+        return -err;
+    }
+
+    err = pthread_create(&w->thread, 0, equeue_watchdog_thread, w);
+    if (err) {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+        return -err;
+    }
+
+    w->hook.pre = equeue_watchdog_pre;
+    w->hook.post = equeue_watchdog_post;
+    w->hook.data = w;
+    equeue_hook(q, &w->hook);
+    return 0;
+}
+
+void equeue_watchdog_destroy(equeue_watchdog_t *w) {
+    // waits for the dispatch loop to leave the hooks, so no hook touches
+    // the watchdog once this returns
+    equeue_unhook(w->q, &w->hook);
+
+    pthread_mutex_lock(&w->lock);
+    w->running = false;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->thread, 0);
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->lock);
+}
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Regression comparison of profiling results
+ *
+ * Compares two sets of results written by prof with PROF_FORMAT=csv and
+ * exits with a non-zero status if any profiler regressed. A regression
+ * must both exceed the threshold and be statistically significant under
+ * Welch's t-test over the individual runs.
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+
+// Comparison configuration
+#define COMPARE_THRESHOLD 5.0
+#define COMPARE_Z 2.576
+#define COMPARE_RESULTS 256
+#define COMPARE_RUNS 256
+
+struct compare_result {
+    char name[128];
+    char units[16];
+    uint64_t median;
+    int count;
+    double runs[COMPARE_RUNS];
+};
+
+static int compare_load(const char *path,
+        struct compare_result *results, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        exit(2);
+    }
+
+    int count = 0;
+    char line[4096];
+    while (count < max && fgets(line, sizeof(line), f)) {
+        struct compare_result *r = &results[count];
+        char runs[4096];
+        double min, stddev;
+
+        if (line[0] == '#' || strncmp(line, "name,", 5) == 0) {
+            continue;
+        }
+
+        if (sscanf(line, "%127[^,],%15[^,],%" SCNu64 ",%lf,%lf,%4095[^,\n]",
+                r->name, r->units, &r->median, &min, &stddev, runs) != 6) {
+            continue;
+        }
+
+        r->count = 0;
+        for (char *run = strtok(runs, ";");
+                run && r->count < COMPARE_RUNS; run = strtok(0, ";")) {
+            r->runs[r->count++] = strtod(run, 0);
+        }
+
+        count += 1;
+    }
+
+    fclose(f);
+    return count;
+}
+
+static void compare_moments(const struct compare_result *r,
+        double *mean, double *var) {
+    *mean = 0;
+    for (int i = 0; i < r->count; i++) {
+        *mean += r->runs[i] / r->count;
+    }
+
+    *var = 0;
+    for (int i = 0; i < r->count; i++) {
+        *var += (r->runs[i] - *mean) * (r->runs[i] - *mean);
+    }
+    *var = r->count > 1 ? *var / (r->count-1) : 0;
+}
+
+// Welch's t-test, with the two-sided 99% critical value of the t
+// distribution approximated by a Cornish-Fisher expansion in the
+// Welch-Satterthwaite degrees of freedom
+static int compare_significant(const struct compare_result *a,
+        const struct compare_result *b) {
+    double ma, va, mb, vb;
+    compare_moments(a, &ma, &va);
+    compare_moments(b, &mb, &vb);
+
+    double sa = va / a->count;
+    double sb = vb / b->count;
+    if (sa + sb == 0) {
+        return ma != mb;
+    }
+
+    double t = fabs(ma - mb) / sqrt(sa + sb);
+    double df = (sa + sb)*(sa + sb) / (
+            (a->count > 1 ? sa*sa / (a->count-1) : 0) +
+            (b->count > 1 ? sb*sb / (b->count-1) : 0));
+
+    double z = COMPARE_Z;
+    double crit = z + (z*z*z + z) / (4*df)
+            + (5*z*z*z*z*z + 16*z*z*z + 3*z) / (96*df*df);
+    return t > crit;
+}
+
+
+// Entry point
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <old.csv> <new.csv> [threshold%%]\n",
+                argv[0]);
+        return 2;
+    }
+
+    double threshold = argc > 3 ? atof(argv[3]) : COMPARE_THRESHOLD;
+
+    static struct compare_result olds[COMPARE_RESULTS];
+    static struct compare_result news[COMPARE_RESULTS];
+    int nolds = compare_load(argv[1], olds, COMPARE_RESULTS);
+    int nnews = compare_load(argv[2], news, COMPARE_RESULTS);
+
+    int regressions = 0;
+    for (int i = 0; i < nnews; i++) {
+        struct compare_result *n = &news[i];
+        struct compare_result *o = 0;
+        for (int j = 0; j < nolds; j++) {
+            if (strcmp(olds[j].name, n->name) == 0) {
+                o = &olds[j];
+                break;
+            }
+        }
+
+        if (!o) {
+            printf("%s: %" PRIu64 " %s (new)\n", n->name, n->median, n->units);
+            continue;
+        }
+
+        double perc = o->median
+                ? 100*((double)n->median - (double)o->median) / o->median
+                : 0;
+        int significant = compare_significant(o, n);
+
+        printf("%s: %" PRIu64 " -> %" PRIu64 " %s (%+.1f%%)",
+                n->name, o->median, n->median, n->units, perc);
+        if (significant && perc > threshold) {
+            printf(" \e[31mregression\e[0m");
+            regressions += 1;
+        } else if (significant && perc < -threshold) {
+            printf(" \e[32mimprovement\e[0m");
+        }
+        printf("\n");
+    }
+
+    if (regressions) {
+        printf("%d regression%s found\n", regressions,
+                regressions == 1 ? "" : "s");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * Dispatch-lag benchmark for the events library
+ *
+ * Drives a mix of immediate, delayed and periodic events at controlled
+ * load levels from a producer thread, recording histograms of how late
+ * events run compared to their target and of the cross-thread wakeup
+ * latency of immediate events. Histograms are written as JSON.
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#include "equeue.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+
+
+// Benchmark configuration
+#define LAG_DURATION 1000
+#define LAG_EVENTS 16384
+#define LAG_PERIODIC 64
+#define LAG_DELAY 100
+#define LAG_WORK 2000
+
+static const int lag_rates[] = {1000, 10000, 50000};
+
+static uint64_t lag_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static uint32_t lag_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+
+// Log-linear histogram with 32 sub-buckets per power of two, giving
+// roughly 3% relative precision over the full range of nanoseconds
+#define LAG_BUCKETS (64 + 58*32)
+
+struct lag_hist {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[LAG_BUCKETS];
+};
+
+static int lag_bucket(uint64_t v) {
+    if (v < 64) {
+        return v;
+    }
+
+    int shift = 63 - __builtin_clzll(v) - 5;
+    return 64 + (shift-1)*32 + (int)((v >> shift) - 32);
+}
+
+static uint64_t lag_bucket_value(int i) {
+    if (i < 64) {
+        return i;
+    }
+
+    int shift = (i-64)/32 + 1;
+    return (uint64_t)((i-64)%32 + 32) << shift;
+}
+
+static void lag_record(struct lag_hist *h, int64_t v) {
+    if (v < 0) {
+        v = 0;
+    }
+
+    h->buckets[lag_bucket(v)] += 1;
+    h->count += 1;
+    if ((uint64_t)v > h->max) {
+        h->max = v;
+    }
+}
+
+static uint64_t lag_percentile(const struct lag_hist *h, double p) {
+    uint64_t rank = (uint64_t)(p * h->count);
+    uint64_t seen = 0;
+    for (int i = 0; i < LAG_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen > rank) {
+            return lag_bucket_value(i);
+        }
+    }
+
+    return h->max;
+}
+
+
+// Workload state
+struct lag_level {
+    equeue_t q;
+    int rate;
+
+    struct lag_hist lag;
+    struct lag_hist wakeup;
+};
+
+struct lag_event {
+    struct lag_level *l;
+    uint64_t posted;
+    uint64_t target;
+    uint64_t period;
+};
+
+static void lag_work(void) {
+    uint64_t start = lag_ns();
+    while (lag_ns() - start < LAG_WORK);
+}
+
+static void lag_immediate_func(void *p) {
+    struct lag_event *e = (struct lag_event *)p;
+    uint64_t now = lag_ns();
+    lag_record(&e->l->lag, now - e->target);
+    lag_record(&e->l->wakeup, now - e->posted);
+    lag_work();
+}
+
+static void lag_delayed_func(void *p) {
+    struct lag_event *e = (struct lag_event *)p;
+    lag_record(&e->l->lag, lag_ns() - e->target);
+    lag_work();
+}
+
+static void lag_periodic_func(void *p) {
+    struct lag_event *e = (struct lag_event *)p;
+    lag_record(&e->l->lag, lag_ns() - e->target);
+    e->target += e->period;
+    lag_work();
+}
+
+static int lag_post(struct lag_level *l, void (*cb)(void *),
+        int delay, int period) {
+    struct lag_event *e = equeue_alloc(&l->q, sizeof(struct lag_event));
+    if (!e) {
+        return 0;
+    }
+
+    e->l = l;
+    e->posted = lag_ns();
+    e->target = e->posted + (uint64_t)delay*1000000;
+    e->period = (uint64_t)period*1000000;
+    equeue_event_delay(e, delay);
+    equeue_event_period(e, period);
+    return equeue_post(&l->q, cb, e);
+}
+
+static void *lag_dispatcher(void *p) {
+    struct lag_level *l = (struct lag_level *)p;
+    equeue_dispatch(&l->q, -1);
+    return 0;
+}
+
+
+// Run a single load level
+static void lag_run(struct lag_level *l, int ms) {
+    equeue_create(&l->q, LAG_EVENTS*EQUEUE_EVENT_SIZE);
+    uint32_t seed = l->rate;
+
+    pthread_t thread;
+    pthread_create(&thread, 0, lag_dispatcher, l);
+
+    int periodic[LAG_PERIODIC];
+    for (int i = 0; i < LAG_PERIODIC; i++) {
+        int period = 10 + lag_random(&seed) % 90;
+        periodic[i] = lag_post(l, lag_periodic_func, period, period);
+    }
+
+    // post 70% immediate and 30% delayed events in 1ms batches
+    uint64_t start = lag_ns();
+    uint64_t posted = 0;
+    while (lag_ns() - start < (uint64_t)ms*1000000) {
+        uint64_t due = (lag_ns() - start) * l->rate / 1000000000;
+        for (; posted < due; posted++) {
+            if (lag_random(&seed) % 10 < 7) {
+                lag_post(l, lag_immediate_func, 0, -1);
+            } else {
+                int delay = 1 + lag_random(&seed) % LAG_DELAY;
+                lag_post(l, lag_delayed_func, delay, -1);
+            }
+        }
+
+        usleep(1000);
+    }
+
+    for (int i = 0; i < LAG_PERIODIC; i++) {
+        equeue_cancel(&l->q, periodic[i]);
+    }
+
+    usleep(2*LAG_DELAY*1000);
+    equeue_break(&l->q);
+    pthread_join(thread, 0);
+    equeue_destroy(&l->q);
+}
+
+
+// Output
+static void lag_summary(int rate, const char *name,
+        const struct lag_hist *h) {
+    printf("%6d %-7s %9" PRIu64 " %9.1f %9.1f %9.1f %9.1f\n",
+            rate, name, h->count,
+            lag_percentile(h, 0.5) / 1e3,
+            lag_percentile(h, 0.99) / 1e3,
+            lag_percentile(h, 0.999) / 1e3,
+            h->max / 1e3);
+}
+
+static void lag_json(FILE *f, const char *name, const struct lag_hist *h) {
+    fprintf(f, "\"%s\": {\"count\": %" PRIu64 ", \"max\": %" PRIu64
+            ", \"p50\": %" PRIu64 ", \"p99\": %" PRIu64
+            ", \"p999\": %" PRIu64 ", \"buckets\": [",
+            name, h->count, h->max,
+            lag_percentile(h, 0.5),
+            lag_percentile(h, 0.99),
+            lag_percentile(h, 0.999));
+
+    const char *sep = "";
+    for (int i = 0; i < LAG_BUCKETS; i++) {
+        if (h->buckets[i]) {
+            fprintf(f, "%s[%" PRIu64 ", %" PRIu64 "]",
+                    sep, lag_bucket_value(i), h->buckets[i]);
+            sep = ", ";
+        }
+    }
+
+    fprintf(f, "]}");
+}
+
+
+// Entry point
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "tests/lag.json";
+    int ms = argc > 2 ? atoi(argv[2]) : LAG_DURATION;
+    int count = sizeof(lag_rates) / sizeof(lag_rates[0]);
+
+    struct lag_level *levels = calloc(count, sizeof(struct lag_level));
+
+    printf("beginning lag measurement...\n");
+    printf("%6s %-7s %9s %9s %9s %9s %9s\n",
+            "rate", "hist", "count", "p50", "p99", "p999", "max");
+    printf("%6s %-7s %9s %9s %9s %9s %9s\n",
+            "(e/s)", "", "", "(us)", "(us)", "(us)", "(us)");
+
+    for (int i = 0; i < count; i++) {
+        struct lag_level *l = &levels[i];
+        l->rate = lag_rates[i];
+        lag_run(l, ms);
+
+        lag_summary(l->rate, "lag", &l->lag);
+        lag_summary(l->rate, "wakeup", &l->wakeup);
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+
+    fprintf(f, "{\"unit\": \"ns\", \"levels\": [\n");
+    for (int i = 0; i < count; i++) {
+        struct lag_level *l = &levels[i];
+        fprintf(f, "  {\"rate\": %d, ", l->rate);
+        lag_json(f, "lag", &l->lag);
+        fprintf(f, ", ");
+        lag_json(f, "wakeup", &l->wakeup);
+        fprintf(f, "}%s\n", i < count-1 ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    fclose(f);
+
+    printf("results written to %s\n", path);
+    printf("done!\n");
+    free(levels);
+}
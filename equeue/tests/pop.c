@@ -0,0 +1,273 @@
+/*
+ * Large-population timer benchmark for the events library
+ *
+ * Measures the cost of posting, cancelling, rescheduling and expiring
+ * events while a queue holds hundreds of thousands to millions of pending
+ * timeouts, under uniform, clustered and bimodal deadline distributions.
+ * This exposes the algorithmic scaling of the event queue rather than its
+ * constant factors, which are covered by prof.
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#include "equeue.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+
+// Benchmark configuration
+#define POP_POPULATION 1000000
+#define POP_OPS 1000
+#define POP_BUDGET 2000
+#define POP_SPAN (3600*1000)
+#define POP_CLUSTERS 16
+
+static uint64_t pop_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static uint32_t pop_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+static uint32_t pop_random32(uint32_t *seed) {
+    return (pop_random(seed) << 16) ^ pop_random(seed);
+}
+
+
+// Deadline distributions over a span of milliseconds
+enum pop_dist {
+    POP_UNIFORM,
+    POP_CLUSTERED,
+    POP_BIMODAL,
+};
+
+static const char *const pop_dist_names[] = {
+    "uniform",
+    "clustered",
+    "bimodal",
+};
+
+static int pop_delay(enum pop_dist dist, int span, uint32_t *seed) {
+    switch (dist) {
+        case POP_UNIFORM:
+            return pop_random32(seed) % span;
+
+        case POP_CLUSTERED: {
+            // a handful of common timeouts with 1% jitter
+            int cluster = pop_random(seed) % POP_CLUSTERS;
+            int jitter = span/100 + 1;
+            return (cluster*(span/POP_CLUSTERS) + pop_random32(seed) % jitter)
+                    % span;
+        }
+
+        case POP_BIMODAL:
+            // mostly short timeouts with a tail of long ones
+            if (pop_random(seed) % 10 < 9) {
+                return pop_random32(seed) % (span/100 + 1);
+            } else {
+                return span/2 + pop_random32(seed) % (span/2);
+            }
+    }
+
+    return 0;
+}
+
+
+// Population state
+struct pop {
+    equeue_t q;
+    struct equeue_vclock clock;
+    int count;
+    int *ids;
+    int *delays;
+};
+
+static void pop_func(void *p) {
+}
+
+static int pop_post(struct pop *p, int delay) {
+    void *e = equeue_alloc(&p->q, sizeof(int));
+    if (!e) {
+        fprintf(stderr, "pop: out of memory\n");
+        exit(1);
+    }
+
+    equeue_event_delay(e, delay);
+    return equeue_post(&p->q, pop_func, e);
+}
+
+static int pop_cmp(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x < y) - (x > y);
+}
+
+// Events are posted in descending order of deadline so each post lands
+// at the head of the queue, otherwise building the population would
+// itself be quadratic. The queue runs on a virtual clock so the population
+// can be expired without waiting out the span
+static void pop_build(struct pop *p, int count,
+        enum pop_dist dist, int span, uint32_t *seed) {
+    p->count = count;
+    p->ids = malloc(count*sizeof(int));
+    p->delays = malloc(count*sizeof(int));
+
+    size_t size = (size_t)(count + 2*POP_OPS) * EQUEUE_EVENT_SIZE;
+    if (!p->ids || !p->delays || equeue_create(&p->q, size) < 0) {
+        fprintf(stderr, "pop: out of memory\n");
+        exit(1);
+    }
+
+    p->clock.tick = 0;
+    equeue_clock(&p->q, equeue_vclock_tick, equeue_vclock_advance, &p->clock);
+
+    for (int i = 0; i < count; i++) {
+        p->delays[i] = pop_delay(dist, span, seed);
+    }
+    qsort(p->delays, count, sizeof(int), pop_cmp);
+
+    for (int i = 0; i < count; i++) {
+        p->ids[i] = pop_post(p, p->delays[i]);
+    }
+}
+
+static void pop_destroy(struct pop *p) {
+    equeue_destroy(&p->q);
+    free(p->ids);
+    free(p->delays);
+}
+
+
+// Operations, each restores the population so it remains constant
+static uint64_t pop_post_op(struct pop *p, enum pop_dist dist,
+        uint32_t *seed) {
+    int delay = pop_delay(dist, POP_SPAN, seed);
+    void *e = equeue_alloc(&p->q, sizeof(int));
+    if (!e) {
+        fprintf(stderr, "pop: out of memory\n");
+        exit(1);
+    }
+
+    equeue_event_delay(e, delay);
+
+    uint64_t start = pop_ns();
+    int id = equeue_post(&p->q, pop_func, e);
+    uint64_t ns = pop_ns() - start;
+
+    equeue_cancel(&p->q, id);
+    return ns;
+}
+
+static uint64_t pop_cancel_op(struct pop *p, enum pop_dist dist,
+        uint32_t *seed) {
+    int i = pop_random32(seed) % p->count;
+
+    uint64_t start = pop_ns();
+    equeue_cancel(&p->q, p->ids[i]);
+    uint64_t ns = pop_ns() - start;
+
+    p->ids[i] = pop_post(p, p->delays[i]);
+    return ns;
+}
+
+static uint64_t pop_reschedule_op(struct pop *p, enum pop_dist dist,
+        uint32_t *seed) {
+    int i = pop_random32(seed) % p->count;
+    int delay = pop_delay(dist, POP_SPAN, seed);
+
+    uint64_t start = pop_ns();
+    equeue_cancel(&p->q, p->ids[i]);
+    p->ids[i] = pop_post(p, delay);
+    uint64_t ns = pop_ns() - start;
+
+    p->delays[i] = delay;
+    return ns;
+}
+
+
+// Percentiles over collected samples
+static int pop_sample_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void pop_summary(int count, enum pop_dist dist, const char *op,
+        int ops, uint64_t *samples, int n) {
+    qsort(samples, n, sizeof(uint64_t), pop_sample_cmp);
+
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++) {
+        total += samples[i];
+    }
+
+    printf("%10d %-9s %-10s %8d %12.0f %12" PRIu64 " %12" PRIu64 "\n",
+            count, pop_dist_names[dist], op, ops,
+            (double)total / n,
+            samples[n/2],
+            samples[(int)(0.99*(n-1))]);
+    fflush(stdout);
+}
+
+static void pop_run(struct pop *p, enum pop_dist dist, const char *op,
+        uint64_t (*func)(struct pop *, enum pop_dist, uint32_t *),
+        int ops, uint32_t *seed) {
+    uint64_t *samples = malloc(ops*sizeof(uint64_t));
+    uint64_t start = pop_ns();
+
+    int n = 0;
+    while (n < ops && (n < 10 ||
+            pop_ns() - start < (uint64_t)POP_BUDGET*1000000)) {
+        samples[n++] = func(p, dist, seed);
+    }
+
+    pop_summary(p->count, dist, op, n, samples, n);
+    free(samples);
+}
+
+// Expiry dispatches the whole population in deadline order
+static void pop_expire(struct pop *p, enum pop_dist dist) {
+    uint64_t start = pop_ns();
+    equeue_dispatch(&p->q, POP_SPAN);
+    uint64_t ns = pop_ns() - start;
+
+    uint64_t sample = ns / p->count;
+    pop_summary(p->count, dist, "expire", p->count, &sample, 1);
+}
+
+
+// Entry point
+int main(int argc, char **argv) {
+    int max = argc > 1 ? atoi(argv[1]) : POP_POPULATION;
+    int ops = argc > 2 ? atoi(argv[2]) : POP_OPS;
+
+    printf("beginning population scaling...\n");
+    printf("%10s %-9s %-10s %8s %12s %12s %12s\n",
+            "population", "dist", "op", "ops", "mean", "p50", "p99");
+    printf("%10s %-9s %-10s %8s %12s %12s %12s\n",
+            "", "", "", "", "(ns)", "(ns)", "(ns)");
+
+    for (int count = 100000; count <= max; count *= 10) {
+        for (int dist = POP_UNIFORM; dist <= POP_BIMODAL; dist++) {
+            uint32_t seed = count + dist;
+
+            struct pop p;
+            pop_build(&p, count, dist, POP_SPAN, &seed);
+            pop_run(&p, dist, "post", pop_post_op, ops, &seed);
+            pop_run(&p, dist, "cancel", pop_cancel_op, ops, &seed);
+            pop_run(&p, dist, "reschedule", pop_reschedule_op, ops, &seed);
+            pop_expire(&p, dist);
+            pop_destroy(&p);
+        }
+    }
+
+    printf("done!\n");
+}
@@ -4,103 +4,16 @@
  * Copyright (c) 2016 Christopher Haster
  * Distributed under the MIT license
  */
+#define _GNU_SOURCE
 #include "equeue.h"
-#include <unistd.h>
+#include "prof.h"
 #include <stdio.h>
 #include <setjmp.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <inttypes.h>
 #include <sys/time.h>
 
 
-// Performance measurement utils
-#define PROF_RUNS 5
-#define PROF_INTERVAL 100000000
-
-#define prof_volatile(t) __attribute__((unused)) volatile t
-
-typedef uint64_t prof_cycle_t;
-
-static volatile prof_cycle_t prof_start_cycle;
-static volatile prof_cycle_t prof_stop_cycle;
-static prof_cycle_t prof_accum_cycle;
-static prof_cycle_t prof_baseline_cycle;
-static prof_cycle_t prof_iterations;
-static const char *prof_units;
-
-#define prof_cycle() ({                                                     \
-    uint32_t a, b;                                                          \
-    __asm__ volatile ("rdtsc" : "=a" (a), "=d" (b));                        \
-    ((uint64_t)b << 32) | (uint64_t)a;                                      \
-})
-
-#define prof_loop()                                                         \
-    for (prof_iterations = 0;                                               \
-         prof_accum_cycle < PROF_INTERVAL;                                  \
-         prof_iterations++)
-
-#define prof_start() ({                                                     \
-    prof_start_cycle = prof_cycle();                                        \
-})
-
-#define prof_stop() ({                                                      \
-    prof_stop_cycle = prof_cycle();                                         \
-    prof_accum_cycle += prof_stop_cycle - prof_start_cycle;                 \
-})
-
-#define prof_result(value, units) ({                                        \
-    prof_accum_cycle = value+prof_baseline_cycle;                           \
-    prof_iterations = 1;                                                    \
-    prof_units = units;                                                     \
-})
-
-#define prof_measure(func, ...) ({                                          \
-    printf("%s: ...", #func);                                               \
-    fflush(stdout);                                                         \
-                                                                            \
-    prof_units = "cycles";                                                  \
-    prof_cycle_t runs[PROF_RUNS];                                           \
-    for (int i = 0; i < PROF_RUNS; i++) {                                   \
-        prof_accum_cycle = 0;                                               \
-        prof_iterations = 0;                                                \
-        func(__VA_ARGS__);                                                  \
-        runs[i] = prof_accum_cycle / prof_iterations;                       \
-    }                                                                       \
-                                                                            \
-    prof_cycle_t res = runs[0];                                             \
-    for (int i = 0; i < PROF_RUNS; i++) {                                   \
-        if (runs[i] < res) {                                                \
-            res = runs[i];                                                  \
-        }                                                                   \
-    }                                                                       \
-    res -= prof_baseline_cycle;                                             \
-    printf("\r%s: %"PRIu64" %s", #func, res, prof_units);                   \
-                                                                            \
-    if (!isatty(0)) {                                                       \
-        prof_cycle_t prev;                                                  \
-        while (scanf("%*[^0-9]%"PRIu64, &prev) == 0);                       \
-        int64_t perc = 100*((int64_t)prev - (int64_t)res) / (int64_t)prev;  \
-                                                                            \
-        if (perc > 10) {                                                    \
-            printf(" (\e[32m%+"PRId64"%%\e[0m)", perc);                     \
-        } else if (perc < -10) {                                            \
-            printf(" (\e[31m%+"PRId64"%%\e[0m)", perc);                     \
-        } else {                                                            \
-            printf(" (%+"PRId64"%%)", perc);                                \
-        }                                                                   \
-    }                                                                       \
-                                                                            \
-    printf("\n");                                                           \
-    res;                                                                    \
-})
-
-#define prof_baseline(func, ...) ({                                         \
-    prof_baseline_cycle = 0;                                                \
-    prof_baseline_cycle = prof_measure(func, __VA_ARGS__);                  \
-})
-
-
 // Various test functions
 void no_func(void *eh) {
 }
@@ -371,7 +284,7 @@ void equeue_alloc_fragmented_size_prof(int count) {
 
 // Entry point
 int main() {
-    printf("beginning profiling...\n");
+    prof_begin();
 
     prof_baseline(baseline_prof);
 
@@ -392,5 +305,5 @@ int main() {
     prof_measure(equeue_alloc_many_size_prof, 1000);
     prof_measure(equeue_alloc_fragmented_size_prof, 1000);
 
-    printf("done!\n");
+    prof_end();
 }
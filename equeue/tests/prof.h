@@ -0,0 +1,490 @@
+/*
+ * Profiling framework for the events library
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#ifndef PROF_H
+#define PROF_H
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+#include <sys/utsname.h>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+// Performance measurement utils
+//
+// The output format is selected with the PROF_FORMAT environment variable,
+// either text (default), json or csv. The structured formats include every
+// run so results can be compared with tests/compare.
+//
+// Setting PROF_COUNTERS=1 additionally collects instructions, cache misses,
+// branch misses and context switches per iteration through perf_event_open
+// on Linux. The counters are toggled around every prof_start/prof_stop, so
+// this makes profiling considerably slower.
+#ifndef PROF_RUNS
+#define PROF_RUNS 10
+#endif
+
+#define prof_volatile(t) __attribute__((unused)) volatile t
+
+typedef uint64_t prof_cycle_t;
+
+static volatile prof_cycle_t prof_start_cycle;
+static volatile prof_cycle_t prof_stop_cycle;
+static prof_cycle_t prof_accum_cycle;
+static prof_cycle_t prof_baseline_cycle;
+static prof_cycle_t prof_iterations;
+static prof_cycle_t prof_total_iterations;
+static prof_cycle_t prof_interval = 100000000;
+static const char *prof_units;
+static int prof_format;
+static int prof_count;
+
+enum {
+    PROF_FORMAT_TEXT,
+    PROF_FORMAT_JSON,
+    PROF_FORMAT_CSV,
+};
+
+// Cycle counter, falling back to a nanosecond clock where no cycle
+// counter is available
+#if defined(__x86_64__) || defined(__i386__)
+#define PROF_CLOCK "rdtsc"
+#define PROF_UNITS "cycles"
+#define prof_cycle() ({                                                     \
+    uint32_t a, b;                                                          \
+    __asm__ volatile ("rdtsc" : "=a" (a), "=d" (b));                        \
+    ((uint64_t)b << 32) | (uint64_t)a;                                      \
+})
+#elif defined(__aarch64__)
+#define PROF_CLOCK "cntvct_el0"
+#define PROF_UNITS "ticks"
+#define prof_cycle() ({                                                     \
+    uint64_t v;                                                             \
+    __asm__ volatile ("isb; mrs %0, cntvct_el0" : "=r" (v));                \
+    v;                                                                      \
+})
+#else
+#define PROF_CLOCK "clock_gettime"
+#define PROF_UNITS "ns"
+#define prof_cycle() ({                                                     \
+    struct timespec ts;                                                     \
+    clock_gettime(CLOCK_MONOTONIC, &ts);                                    \
+    (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;                  \
+})
+#endif
+
+#define prof_loop()                                                         \
+    for (prof_iterations = 0;                                               \
+         prof_accum_cycle < prof_interval;                                  \
+         prof_iterations++)
+
+#define prof_start() ({                                                     \
+    if (prof_counter_leader >= 0) {                                         \
+        prof_counters_toggle(true);                                         \
+    }                                                                       \
+    prof_start_cycle = prof_cycle();                                        \
+})
+
+#define prof_stop() ({                                                      \
+    prof_stop_cycle = prof_cycle();                                         \
+    if (prof_counter_leader >= 0) {                                         \
+        prof_counters_toggle(false);                                        \
+    }                                                                       \
+    prof_accum_cycle += prof_stop_cycle - prof_start_cycle;                 \
+})
+
+#define prof_result(value, units) ({                                        \
+    prof_accum_cycle = value+prof_baseline_cycle;                           \
+    prof_iterations = 1;                                                    \
+    prof_units = units;                                                     \
+})
+
+#define prof_measure(func, ...) ({                                          \
+    prof_announce(#func);                                                   \
+                                                                            \
+    prof_units = PROF_UNITS;                                                \
+    prof_counters_reset();                                                  \
+    prof_total_iterations = 0;                                              \
+    prof_cycle_t runs[PROF_RUNS];                                           \
+    for (int i = 0; i < PROF_RUNS; i++) {                                   \
+        prof_accum_cycle = 0;                                               \
+        prof_iterations = 0;                                                \
+        func(__VA_ARGS__);                                                  \
+        runs[i] = prof_accum_cycle / prof_iterations;                       \
+        prof_total_iterations += prof_iterations;                           \
+    }                                                                       \
+                                                                            \
+    prof_report(#func, #__VA_ARGS__, runs);                                 \
+})
+
+#define prof_baseline(func, ...) ({                                         \
+    prof_baseline_cycle = 0;                                                \
+    memset(prof_baseline_counter, 0, sizeof(prof_baseline_counter));        \
+    prof_baseline_cycle = prof_measure(func, __VA_ARGS__);                  \
+    memcpy(prof_baseline_counter, prof_counter, sizeof(prof_counter));      \
+})
+
+
+// Hardware counters through perf_event_open, grouped under a single
+// leader so they can be toggled and read with one syscall
+#define PROF_COUNTERS 4
+
+static const char *const prof_counter_names[PROF_COUNTERS] = {
+    "instructions",
+    "cache-misses",
+    "branch-misses",
+    "context-switches",
+};
+
+static int prof_counter_leader = -1;
+static int prof_counter_slots[PROF_COUNTERS];
+static int prof_counter_count;
+static double prof_counter[PROF_COUNTERS];
+static double prof_baseline_counter[PROF_COUNTERS];
+
+static inline void prof_counters_open(void) {
+#if defined(__linux__)
+    static const uint32_t types[PROF_COUNTERS] = {
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_HARDWARE,
+        PERF_TYPE_SOFTWARE,
+    };
+
+    static const uint64_t configs[PROF_COUNTERS] = {
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_SW_CONTEXT_SWITCHES,
+    };
+
+    for (int i = 0; i < PROF_COUNTERS; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = types[i];
+        attr.config = configs[i];
+        attr.disabled = prof_counter_leader < 0;
+        attr.exclude_kernel = types[i] == PERF_TYPE_HARDWARE;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        int fd = syscall(__NR_perf_event_open, &attr, 0, -1,
+                prof_counter_leader, 0);
+        if (fd < 0) {
+            prof_counter_slots[i] = -1;
+            fprintf(stderr, "prof: %s counter unavailable\n",
+                    prof_counter_names[i]);
+            continue;
+        }
+
+        if (prof_counter_leader < 0) {
+            prof_counter_leader = fd;
+        }
+        prof_counter_slots[i] = prof_counter_count++;
+    }
+#else
+    fprintf(stderr, "prof: counters are only supported on Linux\n");
+#endif
+}
+
+static inline void prof_counters_toggle(bool enable) {
+#if defined(__linux__)
+    ioctl(prof_counter_leader,
+            enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE,
+            PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+static inline void prof_counters_reset(void) {
+    memset(prof_counter, 0, sizeof(prof_counter));
+#if defined(__linux__)
+    if (prof_counter_leader >= 0) {
+        ioctl(prof_counter_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+// Reads counters as averages per iteration, relative to the baseline
+static inline bool prof_counters_read(void) {
+#if defined(__linux__)
+    if (prof_counter_leader < 0 || !prof_total_iterations) {
+        return false;
+    }
+
+    uint64_t values[1+PROF_COUNTERS];
+    if (read(prof_counter_leader, values, sizeof(values)) < 0) {
+        return false;
+    }
+
+    for (int i = 0; i < PROF_COUNTERS; i++) {
+        if (prof_counter_slots[i] >= 0) {
+            prof_counter[i] = (double)values[1+prof_counter_slots[i]]
+                    / prof_total_iterations - prof_baseline_counter[i];
+        }
+    }
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+// Statistics over runs
+static int prof_cmp(const void *a, const void *b) {
+    prof_cycle_t x = *(const prof_cycle_t *)a;
+    prof_cycle_t y = *(const prof_cycle_t *)b;
+    return (x > y) - (x < y);
+}
+
+static inline void prof_stats(prof_cycle_t *runs,
+        prof_cycle_t *min, prof_cycle_t *median, double *stddev) {
+    prof_cycle_t sorted[PROF_RUNS];
+    memcpy(sorted, runs, sizeof(sorted));
+    qsort(sorted, PROF_RUNS, sizeof(prof_cycle_t), prof_cmp);
+
+    *min = sorted[0];
+    *median = sorted[PROF_RUNS/2];
+    if (PROF_RUNS % 2 == 0) {
+        *median = (sorted[PROF_RUNS/2-1] + sorted[PROF_RUNS/2]) / 2;
+    }
+
+    double mean = 0;
+    for (int i = 0; i < PROF_RUNS; i++) {
+        mean += (double)runs[i] / PROF_RUNS;
+    }
+
+    double var = 0;
+    for (int i = 0; i < PROF_RUNS; i++) {
+        var += ((double)runs[i] - mean) * ((double)runs[i] - mean);
+    }
+    *stddev = PROF_RUNS > 1 ? sqrt(var / (PROF_RUNS-1)) : 0;
+}
+
+
+// Metadata for structured output
+static inline void prof_cpu(char *buffer, size_t size) {
+    snprintf(buffer, size, "unknown");
+
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (!f) {
+        return;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char *value = strchr(line, ':');
+        if (value && (strncmp(line, "model name", 10) == 0 ||
+                      strncmp(line, "CPU part", 8) == 0)) {
+            value += 2;
+            value[strcspn(value, "\n")] = '\0';
+            snprintf(buffer, size, "%s", value);
+            break;
+        }
+    }
+
+    fclose(f);
+}
+
+static inline void prof_begin(void) {
+    const char *format = getenv("PROF_FORMAT");
+    if (format && strcmp(format, "json") == 0) {
+        prof_format = PROF_FORMAT_JSON;
+    } else if (format && strcmp(format, "csv") == 0) {
+        prof_format = PROF_FORMAT_CSV;
+    } else {
+        prof_format = PROF_FORMAT_TEXT;
+    }
+
+#if defined(__aarch64__)
+    // the generic timer runs at a fixed frequency, measure for ~100ms
+    uint64_t freq;
+    __asm__ volatile ("mrs %0, cntfrq_el0" : "=r" (freq));
+    prof_interval = freq / 10;
+#endif
+
+    const char *counters = getenv("PROF_COUNTERS");
+    if (counters && strcmp(counters, "0") != 0) {
+        prof_counters_open();
+    }
+
+    if (prof_format == PROF_FORMAT_TEXT) {
+        printf("beginning profiling...\n");
+        return;
+    }
+
+    char cpu[128];
+    prof_cpu(cpu, sizeof(cpu));
+    struct utsname uts;
+    uname(&uts);
+
+#if defined(__VERSION__)
+    const char *compiler = __VERSION__;
+#else
+    const char *compiler = "unknown";
+#endif
+
+    if (prof_format == PROF_FORMAT_JSON) {
+        printf("{\"meta\": {\"cpu\": \"%s\", \"machine\": \"%s\", "
+                "\"system\": \"%s %s\", \"compiler\": \"%s\", "
+                "\"clock\": \"%s\", \"runs\": %d, \"counters\": %s},\n",
+                cpu, uts.machine, uts.sysname, uts.release, compiler,
+                PROF_CLOCK, PROF_RUNS,
+                prof_counter_leader >= 0 ? "true" : "false");
+        printf(" \"results\": [");
+    } else {
+        printf("# cpu=%s\n", cpu);
+        printf("# machine=%s\n", uts.machine);
+        printf("# system=%s %s\n", uts.sysname, uts.release);
+        printf("# compiler=%s\n", compiler);
+        printf("# clock=%s\n", PROF_CLOCK);
+        printf("# runs=%d\n", PROF_RUNS);
+        printf("name,units,median,min,stddev,runs");
+        for (int i = 0; prof_counter_leader >= 0 && i < PROF_COUNTERS; i++) {
+            printf(",%s", prof_counter_names[i]);
+        }
+        printf("\n");
+    }
+}
+
+static inline void prof_end(void) {
+    if (prof_format == PROF_FORMAT_JSON) {
+        printf("\n]}\n");
+    } else if (prof_format == PROF_FORMAT_TEXT) {
+        printf("done!\n");
+    }
+}
+
+
+// Reporting of each measurement
+static inline void prof_announce(const char *name) {
+    FILE *f = prof_format == PROF_FORMAT_TEXT ? stdout : stderr;
+    fprintf(f, "%s: ...", name);
+    fflush(f);
+}
+
+static inline prof_cycle_t prof_report(const char *name, const char *args,
+        prof_cycle_t *runs) {
+    for (int i = 0; i < PROF_RUNS; i++) {
+        runs[i] = runs[i] > prof_baseline_cycle
+                ? runs[i] - prof_baseline_cycle : 0;
+    }
+
+    prof_cycle_t min, median;
+    double stddev;
+    prof_stats(runs, &min, &median, &stddev);
+
+    // counters are only meaningful for measurements made with prof_loop
+    bool counters = false;
+    if (strcmp(prof_units, PROF_UNITS) == 0) {
+        counters = prof_counters_read();
+    }
+
+    if (prof_format != PROF_FORMAT_TEXT) {
+        fprintf(stderr, "\r%s: %" PRIu64 " %s\n", name, min, prof_units);
+
+        // include arguments so repeated profilers have unique names
+        char full[256];
+        snprintf(full, sizeof(full), *args ? "%s(%s)" : "%s", name, args);
+
+        if (prof_format == PROF_FORMAT_JSON) {
+            printf("%s\n  {\"name\": \"%s\", \"units\": \"%s\", "
+                    "\"median\": %" PRIu64 ", \"min\": %" PRIu64 ", "
+                    "\"stddev\": %.2f, \"runs\": [",
+                    prof_count ? "," : "", full, prof_units,
+                    median, min, stddev);
+            for (int i = 0; i < PROF_RUNS; i++) {
+                printf("%s%" PRIu64, i ? ", " : "", runs[i]);
+            }
+            printf("]");
+
+            if (counters) {
+                const char *sep = "";
+                printf(", \"counters\": {");
+                for (int i = 0; i < PROF_COUNTERS; i++) {
+                    if (prof_counter_slots[i] >= 0) {
+                        printf("%s\"%s\": %.3f", sep,
+                                prof_counter_names[i], prof_counter[i]);
+                        sep = ", ";
+                    }
+                }
+                printf("}");
+            }
+            printf("}");
+        } else {
+            printf("%s,%s,%" PRIu64 ",%" PRIu64 ",%.2f,",
+                    full, prof_units, median, min, stddev);
+            for (int i = 0; i < PROF_RUNS; i++) {
+                printf("%s%" PRIu64, i ? ";" : "", runs[i]);
+            }
+
+            for (int i = 0; prof_counter_leader >= 0 && i < PROF_COUNTERS; i++) {
+                if (counters && prof_counter_slots[i] >= 0) {
+                    printf(",%.3f", prof_counter[i]);
+                } else {
+                    printf(",");
+                }
+            }
+            printf("\n");
+        }
+
+        fflush(stdout);
+        prof_count += 1;
+        return min;
+    }
+
+    printf("\r%s: %" PRIu64 " %s", name, min, prof_units);
+
+    if (counters) {
+        const char *sep = "";
+        printf(" [");
+        for (int i = 0; i < PROF_COUNTERS; i++) {
+            if (prof_counter_slots[i] >= 0) {
+                printf("%s%s %.2f", sep,
+                        prof_counter_names[i], prof_counter[i]);
+                sep = ", ";
+            }
+        }
+        printf("]");
+    }
+
+    // compare with previous text results piped into stdin
+    if (!isatty(0)) {
+        prof_cycle_t prev;
+        int res;
+        while ((res = scanf("%*[^0-9]%" PRIu64, &prev)) == 0);
+
+        if (res == 1 && prev) {
+            int64_t perc = 100*((int64_t)prev - (int64_t)min) / (int64_t)prev;
+            if (perc > 10) {
+                printf(" (\e[32m%+" PRId64 "%%\e[0m)", perc);
+            } else if (perc < -10) {
+                printf(" (\e[31m%+" PRId64 "%%\e[0m)", perc);
+            } else {
+                printf(" (%+" PRId64 "%%)", perc);
+            }
+        }
+    }
+
+    printf("\n");
+    prof_count += 1;
+    return min;
+}
+
+
+#endif
@@ -0,0 +1,446 @@
+/*
+ * Reference scheduler comparison for the events library
+ *
+ * Runs identical workloads against equeue and a couple of straightforward
+ * reference schedulers, a std::priority_queue guarded by a mutex and
+ * condition variable, and a naive hashed timing wheel, reporting
+ * throughput and latency side by side.
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#include "equeue.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+// Benchmark configuration
+#define REF_DURATION 500
+#define REF_EVENTS 4096
+#define REF_RATE 20000
+#define REF_DELAY 100
+#define REF_WHEEL 1024
+
+static uint64_t ref_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t ref_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+
+// Workload state shared by all schedulers
+struct ref_run {
+    std::atomic<uint64_t> outstanding;
+    uint64_t dispatched;
+    std::vector<uint64_t> samples;
+};
+
+struct ref_payload {
+    ref_run *run;
+    uint64_t target;
+};
+
+static void ref_event(const ref_payload &p) {
+    uint64_t now = ref_ns();
+    p.run->samples.push_back(now > p.target ? now - p.target : 0);
+    p.run->dispatched += 1;
+}
+
+// called once an event is either dispatched or cancelled
+static void ref_release(const ref_payload &p) {
+    p.run->outstanding -= 1;
+}
+
+class ref_scheduler {
+public:
+    virtual ~ref_scheduler() {}
+    virtual const char *name() const = 0;
+
+    // returns a non-zero id that can be cancelled, or 0 if out of memory
+    virtual int post(int ms, const ref_payload &p) = 0;
+    virtual void cancel(int id) = 0;
+
+    // dispatches on the calling thread until stopped
+    virtual void dispatch() = 0;
+    virtual void stop() = 0;
+};
+
+
+// equeue
+class ref_equeue : public ref_scheduler {
+public:
+    ref_equeue() {
+        equeue_create(&_q, REF_EVENTS*EQUEUE_EVENT_SIZE);
+    }
+
+    ~ref_equeue() {
+        equeue_destroy(&_q);
+    }
+
+    const char *name() const {
+        return "equeue";
+    }
+
+    int post(int ms, const ref_payload &p) {
+        ref_payload *e = (ref_payload *)equeue_alloc(&_q, sizeof(ref_payload));
+        if (!e) {
+            return 0;
+        }
+
+        *e = p;
+        equeue_event_delay(e, ms);
+        equeue_event_dtor(e, &ref_equeue::dtor);
+        return equeue_post(&_q, &ref_equeue::thunk, e);
+    }
+
+    void cancel(int id) {
+        equeue_cancel(&_q, id);
+    }
+
+    void dispatch() {
+        equeue_dispatch(&_q, -1);
+    }
+
+    void stop() {
+        equeue_break(&_q);
+    }
+
+private:
+    static void thunk(void *p) {
+        ref_event(*(ref_payload *)p);
+    }
+
+    static void dtor(void *p) {
+        ref_release(*(ref_payload *)p);
+    }
+
+    equeue_t _q;
+};
+
+
+// std::priority_queue with lazy cancellation
+class ref_heap : public ref_scheduler {
+public:
+    ref_heap() : _id(0), _stop(false) {}
+
+    const char *name() const {
+        return "heap";
+    }
+
+    int post(int ms, const ref_payload &p) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        int id = ++_id ? _id : ++_id;
+        entry e = {ref_ns() + (uint64_t)ms*1000000, id, p};
+        _heap.push(e);
+        _pending[id] = p;
+        _cond.notify_one();
+        return id;
+    }
+
+    void cancel(int id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::unordered_map<int, ref_payload>::iterator i = _pending.find(id);
+        if (i != _pending.end()) {
+            ref_release(i->second);
+            _pending.erase(i);
+        }
+    }
+
+    void dispatch() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_stop) {
+            if (_heap.empty()) {
+                _cond.wait(lock);
+                continue;
+            }
+
+            entry e = _heap.top();
+            uint64_t now = ref_ns();
+            if (e.target > now) {
+                _cond.wait_for(lock, std::chrono::nanoseconds(e.target - now));
+                continue;
+            }
+
+            _heap.pop();
+            if (!_pending.erase(e.id)) {
+                continue;
+            }
+
+            lock.unlock();
+            ref_event(e.payload);
+            ref_release(e.payload);
+            lock.lock();
+        }
+        _stop = false;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _cond.notify_one();
+    }
+
+private:
+    struct entry {
+        uint64_t target;
+        int id;
+        ref_payload payload;
+
+        bool operator<(const entry &other) const {
+            return target != other.target
+                    ? target > other.target
+                    : id - other.id > 0;
+        }
+    };
+
+    std::priority_queue<entry> _heap;
+    std::unordered_map<int, ref_payload> _pending;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    int _id;
+    bool _stop;
+};
+
+
+// Naive hashed timing wheel with 1ms slots
+class ref_wheel : public ref_scheduler {
+public:
+    ref_wheel() : _id(0), _stop(false) {
+        _start = ref_ns();
+        _tick = 0;
+    }
+
+    const char *name() const {
+        return "wheel";
+    }
+
+    int post(int ms, const ref_payload &p) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        int id = ++_id ? _id : ++_id;
+
+        uint64_t target = now_tick() + ms;
+        if (target < _tick) {
+            target = _tick;
+        }
+
+        entry e = {target, id, p};
+        std::list<entry> &slot = _slots[target % REF_WHEEL];
+        _index[id] = slot.insert(slot.end(), e);
+
+        if (ms == 0) {
+            _cond.notify_one();
+        }
+        return id;
+    }
+
+    void cancel(int id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::unordered_map<int, std::list<entry>::iterator>::iterator i =
+                _index.find(id);
+        if (i != _index.end()) {
+            ref_release(i->second->payload);
+            _slots[i->second->target % REF_WHEEL].erase(i->second);
+            _index.erase(i);
+        }
+    }
+
+    void dispatch() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (!_stop) {
+            // run every slot up to the current tick, later rounds stay put
+            uint64_t now = now_tick();
+            for (; _tick <= now; _tick++) {
+                std::list<entry> &slot = _slots[_tick % REF_WHEEL];
+                std::list<entry>::iterator i = slot.begin();
+                while (i != slot.end()) {
+                    if (i->target > _tick) {
+                        ++i;
+                        continue;
+                    }
+
+                    entry e = *i;
+                    _index.erase(e.id);
+                    slot.erase(i);
+
+                    // the slot may change while unlocked, so start over
+                    lock.unlock();
+                    ref_event(e.payload);
+                    ref_release(e.payload);
+                    lock.lock();
+                    i = slot.begin();
+                }
+            }
+
+            // stay on the current tick so immediate events run promptly
+            _tick = now;
+            uint64_t next = _start + (now+1)*1000000;
+            uint64_t t = ref_ns();
+            if (next > t && _slots[now % REF_WHEEL].empty()) {
+                _cond.wait_for(lock, std::chrono::nanoseconds(next - t));
+            }
+        }
+        _stop = false;
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+        _cond.notify_one();
+    }
+
+private:
+    struct entry {
+        uint64_t target;
+        int id;
+        ref_payload payload;
+    };
+
+    uint64_t now_tick() const {
+        return (ref_ns() - _start) / 1000000;
+    }
+
+    std::list<entry> _slots[REF_WHEEL];
+    std::unordered_map<int, std::list<entry>::iterator> _index;
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    uint64_t _start;
+    uint64_t _tick;
+    int _id;
+    bool _stop;
+};
+
+
+// Workloads, a producer thread posts into a dispatching thread
+static int ref_post(ref_scheduler *s, ref_run *run, int ms) {
+    while (run->outstanding >= REF_EVENTS) {
+        std::this_thread::yield();
+    }
+
+    ref_payload p = {run, ref_ns() + (uint64_t)ms*1000000};
+    run->outstanding += 1;
+    int id = s->post(ms, p);
+    if (!id) {
+        run->outstanding -= 1;
+    }
+    return id;
+}
+
+// immediate events posted as fast as they are accepted
+static uint64_t ref_immediate(ref_scheduler *s, ref_run *run, int ms) {
+    uint64_t posted = 0;
+    uint64_t start = ref_ns();
+    while (ref_ns() - start < (uint64_t)ms*1000000) {
+        if (ref_post(s, run, 0)) {
+            posted += 1;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    return posted;
+}
+
+// timers with random delays at a fixed rate, a quarter are cancelled
+static uint64_t ref_timers(ref_scheduler *s, ref_run *run, int ms) {
+    uint32_t seed = 1;
+    int ids[256] = {0};
+    uint64_t posted = 0;
+    uint64_t start = ref_ns();
+    while (ref_ns() - start < (uint64_t)ms*1000000) {
+        uint64_t due = (ref_ns() - start) * REF_RATE / 1000000000;
+        for (; posted < due; posted++) {
+            int i = ref_random(&seed) % 256;
+            if (ids[i] && ref_random(&seed) % 4 == 0) {
+                s->cancel(ids[i]);
+            }
+
+            ids[i] = ref_post(s, run, 1 + ref_random(&seed) % REF_DELAY);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2*REF_DELAY));
+    return posted;
+}
+
+static void ref_measure(const char *workload, ref_scheduler *s,
+        uint64_t (*func)(ref_scheduler *, ref_run *, int), int ms) {
+    ref_run run;
+    run.outstanding = 0;
+    run.dispatched = 0;
+    run.samples.reserve(1 << 22);
+
+    std::thread dispatcher(&ref_scheduler::dispatch, s);
+    uint64_t start = ref_ns();
+    uint64_t posted = func(s, &run, ms);
+
+    while (func == ref_immediate && run.outstanding > 0) {
+        std::this_thread::yield();
+    }
+    uint64_t elapsed = ref_ns() - start;
+
+    s->stop();
+    dispatcher.join();
+
+    std::sort(run.samples.begin(), run.samples.end());
+    size_t n = run.samples.size();
+    printf("%-9s %-7s %10" PRIu64 " %10" PRIu64 " %12.0f %9.1f %9.1f %9.1f\n",
+            workload, s->name(), posted, run.dispatched,
+            run.dispatched / (elapsed / 1e9),
+            n ? run.samples[n/2] / 1e3 : 0,
+            n ? run.samples[(size_t)(0.99*(n-1))] / 1e3 : 0,
+            n ? run.samples[(size_t)(0.999*(n-1))] / 1e3 : 0);
+    fflush(stdout);
+}
+
+
+// Entry point
+int main(int argc, char **argv) {
+    int ms = argc > 1 ? atoi(argv[1]) : REF_DURATION;
+
+    printf("beginning reference comparison...\n");
+    printf("%-9s %-7s %10s %10s %12s %9s %9s %9s\n",
+            "workload", "sched", "posted", "dispatched", "events/s",
+            "p50", "p99", "p999");
+    printf("%-9s %-7s %10s %10s %12s %9s %9s %9s\n",
+            "", "", "", "", "", "(us)", "(us)", "(us)");
+
+    struct {
+        const char *name;
+        uint64_t (*func)(ref_scheduler *, ref_run *, int);
+    } workloads[] = {
+        {"immediate", ref_immediate},
+        {"timers", ref_timers},
+    };
+
+    for (size_t i = 0; i < sizeof(workloads)/sizeof(workloads[0]); i++) {
+        ref_scheduler *schedulers[] = {
+            new ref_equeue, new ref_heap, new ref_wheel,
+        };
+
+        for (size_t j = 0; j < sizeof(schedulers)/sizeof(schedulers[0]); j++) {
+            ref_measure(workloads[i].name, schedulers[j],
+                    workloads[i].func, ms);
+            delete schedulers[j];
+        }
+    }
+
+    printf("done!\n");
+}
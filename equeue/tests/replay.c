@@ -0,0 +1,340 @@
+/*
+ * Workload record and replay for the events library
+ *
+ * Replays a trace of operations written by an equeue_recorder against the
+ * current build on a virtual clock, reporting the time spent in each
+ * operation along with any divergence from the recorded behaviour. This
+ * allows allocator and scheduler changes to be evaluated on recorded
+ * traffic.
+ *
+ * With -r, a synthetic workload is run in real time and recorded instead,
+ * as an example of attaching a recorder and to provide a sample trace.
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#include "equeue.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+
+
+// Replay configuration
+#define REPLAY_DURATION 1000
+#define REPLAY_RATE 10000
+#define REPLAY_EVENTS 4096
+#define REPLAY_PERIODIC 16
+#define REPLAY_PERSISTENT 16
+
+static const char *const replay_names[] = {
+    "start",
+    "alloc",
+    "dealloc",
+    "post",
+    "cancel",
+    "dispatch",
+    "repost",
+};
+
+#define REPLAY_OPS (sizeof(replay_names) / sizeof(replay_names[0]))
+
+static uint64_t replay_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+static uint32_t replay_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+
+// Recording of a synthetic workload
+struct replay_writer {
+    FILE *f;
+    pthread_mutex_t lock;
+    uint64_t count;
+};
+
+static void replay_write(void *p, const struct equeue_record *r) {
+    struct replay_writer *w = (struct replay_writer *)p;
+    pthread_mutex_lock(&w->lock);
+    fwrite(r, sizeof(struct equeue_record), 1, w->f);
+    w->count += 1;
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void replay_func(void *p) {
+}
+
+static void *replay_dispatcher(void *p) {
+    equeue_dispatch((equeue_t *)p, -1);
+    return 0;
+}
+
+static int replay_record(const char *path, int ms) {
+    struct replay_writer w;
+    w.f = fopen(path, "wb");
+    if (!w.f) {
+        perror(path);
+        return 1;
+    }
+    pthread_mutex_init(&w.lock, 0);
+    w.count = 0;
+
+    equeue_t q;
+    equeue_create(&q, REPLAY_EVENTS*EQUEUE_EVENT_SIZE);
+    equeue_recorder(&q, replay_write, &w);
+
+    pthread_t thread;
+    pthread_create(&thread, 0, replay_dispatcher, &q);
+
+    uint32_t seed = 1;
+    for (int i = 0; i < REPLAY_PERIODIC; i++) {
+        int period = 10 + replay_random(&seed) % 90;
+        void *e = equeue_alloc(&q, sizeof(int));
+        equeue_event_delay(e, period);
+        equeue_event_period(e, period);
+        equeue_post(&q, replay_func, e);
+    }
+
+    // persistent events are reposted as debounced timeouts, half of them
+    // expiring if dispatched late
+    void *persistent[REPLAY_PERSISTENT];
+    for (int i = 0; i < REPLAY_PERSISTENT; i++) {
+        persistent[i] = equeue_alloc_expire(&q, sizeof(int),
+                i % 2 ? 5 : -1);
+    }
+
+    // mix of immediate events, timeouts that are mostly cancelled, and
+    // varying sizes, posted in 1ms batches
+    int timeouts[64] = {0};
+    uint64_t start = replay_ns();
+    uint64_t posted = 0;
+    while (replay_ns() - start < (uint64_t)ms*1000000) {
+        uint64_t due = (replay_ns() - start) * REPLAY_RATE / 1000000000;
+        for (; posted < due; posted++) {
+            int kind = replay_random(&seed) % 10;
+            int size = 4 << (replay_random(&seed) % 6);
+            void *e = equeue_alloc(&q, size);
+            if (!e) {
+                continue;
+            }
+
+            if (kind < 6) {
+                equeue_post(&q, replay_func, e);
+            } else if (kind < 9) {
+                int i = replay_random(&seed) % 64;
+                equeue_cancel(&q, timeouts[i]);
+                equeue_event_delay(e, 10 + replay_random(&seed) % 1000);
+                timeouts[i] = equeue_post(&q, replay_func, e);
+            } else {
+                equeue_dealloc(&q, e);
+            }
+        }
+
+        int i = replay_random(&seed) % REPLAY_PERSISTENT;
+        if (persistent[i]) {
+            equeue_repost(&q, replay_func, persistent[i],
+                    replay_random(&seed) % 20);
+        }
+
+        usleep(1000);
+    }
+
+    for (int i = 0; i < REPLAY_PERSISTENT; i++) {
+        if (persistent[i]) {
+            equeue_release(&q, persistent[i]);
+        }
+    }
+
+    equeue_break(&q);
+    pthread_join(thread, 0);
+    equeue_recorder(&q, 0, 0);
+    equeue_destroy(&q);
+
+    fclose(w.f);
+    pthread_mutex_destroy(&w.lock);
+    printf("recorded %" PRIu64 " operations to %s\n", w.count, path);
+    return 0;
+}
+
+
+// Replay of a recorded trace, events are tracked by their offset in the
+// recorded buffer so they can be followed from alloc through to cancel,
+// persistent events are kept in their slot until dealloc
+struct replay_slot {
+    void *event;
+    int recorded;
+    int replayed;
+};
+
+struct replay_stats {
+    uint64_t recorded;
+    uint64_t replayed;
+    uint64_t failed;
+    uint64_t ns;
+};
+
+static uint64_t replay_dispatched;
+
+static void replay_count_func(void *p) {
+    replay_dispatched += 1;
+}
+
+static int replay_replay(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+
+    struct equeue_record r;
+    if (fread(&r, sizeof(r), 1, f) != 1 || r.op != EQUEUE_RECORD_START) {
+        fprintf(stderr, "%s: missing start record\n", path);
+        return 1;
+    }
+
+    size_t size = r.arg;
+    unsigned npw2 = 0;
+    for (size_t s = size; s; s >>= 1) {
+        npw2++;
+    }
+
+    equeue_t q;
+    unsigned begin_tick = r.tick;
+    struct equeue_vclock clock = {r.tick};
+    equeue_create(&q, size);
+    equeue_clock(&q, equeue_vclock_tick, equeue_vclock_advance, &clock);
+
+    struct replay_slot *slots = calloc(size/sizeof(void*) + 1,
+            sizeof(struct replay_slot));
+    struct replay_stats stats[REPLAY_OPS];
+    memset(stats, 0, sizeof(stats));
+
+    printf("beginning replay...\n");
+    uint64_t begin = replay_ns();
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        if (r.op >= REPLAY_OPS) {
+            continue;
+        }
+
+        struct replay_stats *s = &stats[r.op];
+        s->recorded += 1;
+
+        // catch up with the recorded time
+        int diff = (int)(r.tick - clock.tick);
+        if (diff > 0) {
+            uint64_t start = replay_ns();
+            equeue_dispatch(&q, diff);
+            stats[EQUEUE_RECORD_DISPATCH].ns += replay_ns() - start;
+        }
+
+        struct replay_slot *slot = 0;
+        if (r.offset != (unsigned)-1) {
+            slot = &slots[(r.offset & ((1 << npw2)-1)) / sizeof(void*)];
+        }
+
+        uint64_t start = replay_ns();
+        switch (r.op) {
+            case EQUEUE_RECORD_ALLOC:
+                // allocations that failed when recorded are attempted
+                // but not kept
+                if (!slot) {
+                    void *e = equeue_alloc(&q, r.arg);
+                    if (e) {
+                        equeue_dealloc(&q, e);
+                    }
+                    s->failed += 1;
+                    break;
+                }
+
+                slot->event = equeue_alloc_expire(&q, r.arg, r.period);
+                s->replayed += slot->event ? 1 : 0;
+                break;
+
+            case EQUEUE_RECORD_DEALLOC:
+                // releasing also covers events that were never posted
+                if (slot->event) {
+                    equeue_release(&q, slot->event);
+                    slot->event = 0;
+                    s->replayed += 1;
+                }
+                break;
+
+            case EQUEUE_RECORD_POST:
+                if (slot->event) {
+                    equeue_event_delay(slot->event, r.arg);
+                    equeue_event_period(slot->event, r.period);
+                    slot->recorded = r.id;
+                    slot->replayed = equeue_post(&q,
+                            replay_count_func, slot->event);
+                    slot->event = 0;
+                    s->replayed += 1;
+                }
+                break;
+
+            case EQUEUE_RECORD_REPOST:
+                if (slot->event) {
+                    slot->recorded = r.id;
+                    slot->replayed = equeue_repost(&q,
+                            replay_count_func, slot->event, r.arg);
+                    s->replayed += 1;
+                }
+                break;
+
+            case EQUEUE_RECORD_CANCEL:
+                slot = &slots[(r.id & ((1 << npw2)-1)) / sizeof(void*)];
+                if (slot->recorded == r.id) {
+                    equeue_cancel(&q, slot->replayed);
+                    slot->recorded = 0;
+                    s->replayed += 1;
+                }
+                break;
+
+            case EQUEUE_RECORD_DISPATCH:
+                equeue_dispatch(&q, 0);
+                break;
+        }
+        s->ns += replay_ns() - start;
+    }
+
+    stats[EQUEUE_RECORD_DISPATCH].replayed = replay_dispatched;
+    uint64_t elapsed = replay_ns() - begin;
+
+    printf("%-9s %10s %10s %10s %12s\n",
+            "op", "recorded", "replayed", "failed", "total (us)");
+    for (unsigned i = EQUEUE_RECORD_ALLOC; i < REPLAY_OPS; i++) {
+        printf("%-9s %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12.1f\n",
+                replay_names[i], stats[i].recorded, stats[i].replayed,
+                stats[i].failed, stats[i].ns / 1e3);
+    }
+    printf("replayed %u ms in %.1f ms\n",
+            clock.tick - begin_tick, elapsed / 1e6);
+    printf("done!\n");
+
+    equeue_destroy(&q);
+    free(slots);
+    fclose(f);
+    return 0;
+}
+
+
+// Entry point
+int main(int argc, char **argv) {
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        int ms = argc > 3 ? atoi(argv[3]) : REPLAY_DURATION;
+        return replay_record(argv[2], ms);
+    } else if (argc > 1) {
+        return replay_replay(argv[1]);
+    }
+
+    fprintf(stderr, "usage: %s [-r] <trace> [ms]\n", argv[0]);
+    return 2;
+}
@@ -0,0 +1,251 @@
+/*
+ * Multi-producer scaling benchmark for the events library
+ *
+ * Sweeps from 1 to N producer threads posting into one or more dispatch
+ * threads, reporting throughput, time spent waiting on the queue locks,
+ * and post-to-dispatch latency percentiles.
+ *
+ * Lock contention is measured by wrapping equeue_mutex_lock at link time,
+ * so this benchmark must be linked with -Wl,--wrap=equeue_mutex_lock.
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#include "equeue.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+
+// Benchmark configuration
+#define SCALE_PRODUCERS 8
+#define SCALE_DISPATCHERS 1
+#define SCALE_DURATION 250
+#define SCALE_EVENTS 1024
+#define SCALE_SAMPLES (1 << 20)
+
+static uint64_t scale_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
+
+
+// Per-dispatcher state
+struct scale_queue {
+    equeue_t q;
+    pthread_t thread;
+
+    uint64_t dispatched;
+    uint64_t finished;
+    uint64_t *samples;
+    uint64_t nsamples;
+
+    // accumulated in __wrap_equeue_mutex_lock
+    uint64_t queuelock_ns;
+    uint64_t memlock_ns;
+};
+
+struct scale_event {
+    struct scale_queue *s;
+    uint64_t stamp;
+};
+
+static struct scale_queue *scale_queues;
+static int scale_nqueues;
+static volatile int scale_running;
+
+
+// Lock contention measurement, only blocking acquisitions are timed
+void __real_equeue_mutex_lock(equeue_mutex_t *m);
+
+void __wrap_equeue_mutex_lock(equeue_mutex_t *m) {
+    if (pthread_mutex_trylock(m) == 0) {
+        return;
+    }
+
+    uint64_t start = scale_ns();
+    __real_equeue_mutex_lock(m);
+    uint64_t wait = scale_ns() - start;
+
+    for (int i = 0; i < scale_nqueues; i++) {
+        struct scale_queue *s = &scale_queues[i];
+        if (m == &s->q.queuelock) {
+            __atomic_fetch_add(&s->queuelock_ns, wait, __ATOMIC_RELAXED);
+        } else if (m == &s->q.memlock) {
+            __atomic_fetch_add(&s->memlock_ns, wait, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+
+// Producer and dispatcher threads
+static void scale_func(void *p) {
+    struct scale_event *e = (struct scale_event *)p;
+    struct scale_queue *s = e->s;
+
+    s->samples[s->nsamples % SCALE_SAMPLES] = scale_ns() - e->stamp;
+    s->nsamples += 1;
+    s->dispatched += 1;
+}
+
+static void scale_done_func(void *p) {
+    struct scale_queue *s = *(struct scale_queue **)p;
+    s->finished = scale_ns();
+    equeue_break(&s->q);
+}
+
+static void *scale_dispatcher(void *p) {
+    struct scale_queue *s = (struct scale_queue *)p;
+    equeue_dispatch(&s->q, -1);
+    return 0;
+}
+
+static void *scale_producer(void *p) {
+    uintptr_t n = (uintptr_t)p;
+
+    while (scale_running) {
+        struct scale_queue *s = &scale_queues[n++ % scale_nqueues];
+
+        struct scale_event *e;
+        while (!(e = equeue_alloc(&s->q, sizeof(struct scale_event)))) {
+            if (!scale_running) {
+                return 0;
+            }
+            sched_yield();
+        }
+
+        e->s = s;
+        e->stamp = scale_ns();
+        equeue_post(&s->q, scale_func, e);
+    }
+
+    return 0;
+}
+
+
+// Percentiles over collected samples
+static int scale_cmp(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t scale_percentile(uint64_t *samples, uint64_t count,
+        double p) {
+    if (!count) {
+        return 0;
+    }
+
+    uint64_t i = (uint64_t)(p*(count-1));
+    return samples[i];
+}
+
+
+// Run a single point on the curve
+static void scale_run(int producers, int dispatchers, int ms) {
+    scale_nqueues = dispatchers;
+    scale_queues = calloc(dispatchers, sizeof(struct scale_queue));
+
+    for (int i = 0; i < dispatchers; i++) {
+        struct scale_queue *s = &scale_queues[i];
+        equeue_create(&s->q, SCALE_EVENTS*EQUEUE_EVENT_SIZE);
+        s->samples = malloc(SCALE_SAMPLES*sizeof(uint64_t));
+        pthread_create(&s->thread, 0, scale_dispatcher, s);
+    }
+
+    pthread_t threads[producers];
+    scale_running = 1;
+    uint64_t start = scale_ns();
+    for (int i = 0; i < producers; i++) {
+        pthread_create(&threads[i], 0, scale_producer, (void *)(uintptr_t)i);
+    }
+
+    usleep(ms*1000);
+    scale_running = 0;
+    for (int i = 0; i < producers; i++) {
+        pthread_join(threads[i], 0);
+    }
+
+    // drain each queue, events of the same tick dispatch in order
+    for (int i = 0; i < dispatchers; i++) {
+        struct scale_queue *s = &scale_queues[i];
+        struct scale_queue **done;
+        while (!(done = equeue_alloc(&s->q, sizeof(struct scale_queue *)))) {
+            sched_yield();
+        }
+        *done = s;
+        equeue_post(&s->q, scale_done_func, done);
+    }
+
+    uint64_t dispatched = 0;
+    uint64_t finished = start;
+    uint64_t queuelock_ns = 0;
+    uint64_t memlock_ns = 0;
+    uint64_t nsamples = 0;
+    for (int i = 0; i < dispatchers; i++) {
+        struct scale_queue *s = &scale_queues[i];
+        pthread_join(s->thread, 0);
+        dispatched += s->dispatched;
+        queuelock_ns += s->queuelock_ns;
+        memlock_ns += s->memlock_ns;
+        nsamples += s->nsamples < SCALE_SAMPLES ? s->nsamples : SCALE_SAMPLES;
+        if (s->finished > finished) {
+            finished = s->finished;
+        }
+    }
+
+    uint64_t *samples = malloc(nsamples*sizeof(uint64_t));
+    uint64_t *sample = samples;
+    for (int i = 0; i < dispatchers; i++) {
+        struct scale_queue *s = &scale_queues[i];
+        uint64_t n = s->nsamples < SCALE_SAMPLES ? s->nsamples : SCALE_SAMPLES;
+        for (uint64_t j = 0; j < n; j++) {
+            *sample++ = s->samples[j];
+        }
+    }
+    qsort(samples, nsamples, sizeof(uint64_t), scale_cmp);
+
+    double elapsed = (double)(finished - start) / 1e9;
+    printf("%9d %11d %12.0f %12.3f %12.3f %9.1f %9.1f %9.1f\n",
+            producers, dispatchers, dispatched / elapsed,
+            queuelock_ns / 1e6, memlock_ns / 1e6,
+            scale_percentile(samples, nsamples, 0.5) / 1e3,
+            scale_percentile(samples, nsamples, 0.99) / 1e3,
+            scale_percentile(samples, nsamples, 0.999) / 1e3);
+
+    free(samples);
+    for (int i = 0; i < dispatchers; i++) {
+        struct scale_queue *s = &scale_queues[i];
+        free(s->samples);
+        equeue_destroy(&s->q);
+    }
+    free(scale_queues);
+}
+
+
+// Entry point
+int main(int argc, char **argv) {
+    int producers = argc > 1 ? atoi(argv[1]) : SCALE_PRODUCERS;
+    int dispatchers = argc > 2 ? atoi(argv[2]) : SCALE_DISPATCHERS;
+    int ms = argc > 3 ? atoi(argv[3]) : SCALE_DURATION;
+
+    printf("beginning scaling...\n");
+    printf("%9s %11s %12s %12s %12s %9s %9s %9s\n",
+            "producers", "dispatchers", "events/s",
+            "queuelock", "memlock", "p50", "p99", "p999");
+    printf("%9s %11s %12s %12s %12s %9s %9s %9s\n",
+            "", "", "", "(ms)", "(ms)", "(us)", "(us)", "(us)");
+
+    for (int p = 1; p < producers; p *= 2) {
+        scale_run(p, dispatchers, ms);
+    }
+    scale_run(producers, dispatchers, ms);
+
+    printf("done!\n");
+}
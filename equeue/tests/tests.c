@@ -11,6 +11,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <time.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 
 // Testing setup
@@ -345,6 +350,23 @@ void cancel_unnecessarily_test(void) {
     equeue_destroy(&q);
 }
 
+void cancel_sibling_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    int touched = 0;
+    equeue_call_in(&q, 20, simple_func, &touched);
+    int id = equeue_call_in(&q, 10, simple_func, &touched);
+    equeue_call_in(&q, 10, simple_func, &touched);
+    equeue_cancel(&q, id);
+
+    equeue_dispatch(&q, 30);
+    test_assert(touched == 2);
+
+    equeue_destroy(&q);
+}
+
 void loop_protect_test(void) {
     equeue_t q;
     int err = equeue_create(&q, 2048);
@@ -511,6 +533,1498 @@ void background_test(void) {
     test_assert(ms == -1);
 }
 
+void vclock_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct equeue_vclock clock = {0};
+    equeue_clock(&q, equeue_vclock_tick, equeue_vclock_advance, &clock);
+
+    int touched = 0;
+    int ticks = 0;
+    int id1 = equeue_call_in(&q, 60*60*1000, simple_func, &touched);
+    int id2 = equeue_call_every(&q, 1000, simple_func, &ticks);
+    test_assert(id1 && id2);
+
+    equeue_dispatch(&q, 60*60*1000 - 1);
+    test_assert(clock.tick == 60*60*1000 - 1);
+    test_assert(equeue_now(&q) == clock.tick);
+    test_assert(touched == 0);
+    test_assert(ticks == 3599);
+
+    equeue_dispatch(&q, 1);
+    test_assert(clock.tick == 60*60*1000);
+    test_assert(touched == 1);
+    test_assert(ticks == 3600);
+
+    equeue_destroy(&q);
+}
+
+struct recording {
+    struct equeue_record records[16];
+    int count;
+};
+
+void record_func(void *p, const struct equeue_record *r) {
+    struct recording *rec = (struct recording *)p;
+    if (rec->count < 16) {
+        rec->records[rec->count] = *r;
+    }
+    rec->count++;
+}
+
+void recorder_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct recording rec = {.count = 0};
+    equeue_recorder(&q, record_func, &rec);
+    test_assert(rec.count == 1);
+    test_assert(rec.records[0].op == EQUEUE_RECORD_START);
+    test_assert(rec.records[0].arg == 2048);
+
+    int touched = 0;
+    int id1 = equeue_call(&q, simple_func, &touched);
+    int id2 = equeue_call_in(&q, 10, simple_func, &touched);
+    test_assert(id1 && id2);
+    equeue_cancel(&q, id2);
+
+    void *e = equeue_alloc(&q, 8);
+    test_assert(e);
+    equeue_dealloc(&q, e);
+
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 1);
+
+    equeue_recorder(&q, 0, 0);
+    equeue_call(&q, simple_func, &touched);
+    test_assert(rec.count == 9);
+
+    test_assert(rec.records[1].op == EQUEUE_RECORD_ALLOC);
+    test_assert(rec.records[2].op == EQUEUE_RECORD_POST);
+    test_assert(rec.records[2].id == id1);
+    test_assert(rec.records[2].offset == rec.records[1].offset);
+    test_assert(rec.records[3].op == EQUEUE_RECORD_ALLOC);
+    test_assert(rec.records[4].op == EQUEUE_RECORD_POST);
+    test_assert(rec.records[4].id == id2);
+    test_assert(rec.records[4].arg == 10);
+    test_assert(rec.records[5].op == EQUEUE_RECORD_CANCEL);
+    test_assert(rec.records[5].id == id2);
+    test_assert(rec.records[6].op == EQUEUE_RECORD_ALLOC);
+    test_assert(rec.records[6].arg == 8);
+    test_assert(rec.records[7].op == EQUEUE_RECORD_DEALLOC);
+    test_assert(rec.records[7].offset == rec.records[6].offset);
+    test_assert(rec.records[8].op == EQUEUE_RECORD_DISPATCH);
+    test_assert(rec.records[8].id == id1);
+
+    equeue_destroy(&q);
+}
+
+struct locked_recording {
+    pthread_mutex_t lock;
+    struct equeue_record records[8192];
+    int count;
+};
+
+void locked_record_func(void *p, const struct equeue_record *r) {
+    struct locked_recording *rec = (struct locked_recording *)p;
+    pthread_mutex_lock(&rec->lock);
+    if (rec->count < 8192) {
+        rec->records[rec->count++] = *r;
+    }
+    pthread_mutex_unlock(&rec->lock);
+}
+
+void recorder_thread_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    static struct locked_recording rec = {PTHREAD_MUTEX_INITIALIZER};
+    rec.count = 0;
+    equeue_recorder(&q, locked_record_func, &rec);
+
+    pthread_t thread;
+    err = pthread_create(&thread, 0, multithread_thread, &q);
+    test_assert(!err);
+
+    int touched = 0;
+    for (int i = 0; i < 2000; i++) {
+        while (!equeue_call(&q, simple_func, &touched)) {
+            usleep(10);
+        }
+    }
+
+    usleep(10000);
+    equeue_break(&q);
+    err = pthread_join(thread, 0);
+    test_assert(!err);
+    equeue_recorder(&q, 0, 0);
+    test_assert(touched == 2000);
+    test_assert(rec.count < 8192);
+
+    // every dispatch is preceded by the post of the same id
+    for (int i = 0; i < rec.count; i++) {
+        if (rec.records[i].op != EQUEUE_RECORD_DISPATCH) {
+            continue;
+        }
+
+        int j = i-1;
+        while (j >= 0 && !(rec.records[j].id == rec.records[i].id &&
+                (rec.records[j].op == EQUEUE_RECORD_POST ||
+                 rec.records[j].op == EQUEUE_RECORD_DISPATCH))) {
+            j--;
+        }
+        test_assert(j >= 0 && rec.records[j].op == EQUEUE_RECORD_POST);
+    }
+
+    equeue_destroy(&q);
+}
+
+void recorder_repost_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+    struct equeue_vclock clock = {0};
+    equeue_clock(&q, equeue_vclock_tick, equeue_vclock_advance, &clock);
+
+    struct recording rec = {.count = 0};
+    equeue_recorder(&q, record_func, &rec);
+
+    int touched = 0;
+    struct indirect *e = equeue_alloc_expire(&q, sizeof(struct indirect), 5);
+    test_assert(e);
+    e->touched = &touched;
+    int id1 = equeue_repost(&q, indirect_func, e, 10);
+    int id2 = equeue_repost(&q, indirect_func, e, 5);
+    equeue_dispatch(&q, 10);
+    int id3 = equeue_repost(&q, indirect_func, e, 0);
+    equeue_dispatch(&q, 0);
+    equeue_release(&q, e);
+    test_assert(touched == 2);
+
+    equeue_recorder(&q, 0, 0);
+    test_assert(rec.count == 8);
+
+    // persistent events are followed by offset from alloc to dealloc,
+    // with the expiry window carried in the alloc
+    test_assert(rec.records[1].op == EQUEUE_RECORD_ALLOC);
+    test_assert(rec.records[1].arg == sizeof(struct indirect));
+    test_assert(rec.records[1].period == 5);
+    test_assert(rec.records[2].op == EQUEUE_RECORD_REPOST);
+    test_assert(rec.records[2].id == id1 && rec.records[2].arg == 10);
+    test_assert(rec.records[3].op == EQUEUE_RECORD_REPOST);
+    test_assert(rec.records[3].id == id2 && rec.records[3].arg == 5);
+    test_assert(rec.records[4].op == EQUEUE_RECORD_DISPATCH);
+    test_assert(rec.records[4].id == id2);
+    test_assert(rec.records[5].op == EQUEUE_RECORD_REPOST);
+    test_assert(rec.records[5].id == id3 && rec.records[5].arg == 0);
+    test_assert(rec.records[6].op == EQUEUE_RECORD_DISPATCH);
+    test_assert(rec.records[6].id == id3);
+    test_assert(rec.records[7].op == EQUEUE_RECORD_DEALLOC);
+    for (int i = 2; i < 8; i++) {
+        test_assert(rec.records[i].offset == rec.records[1].offset);
+    }
+
+    // replaying the records on a fresh queue dispatches the event twice
+    equeue_t r;
+    err = equeue_create(&r, 2048);
+    test_assert(!err);
+    struct equeue_vclock rclock = {0};
+    equeue_clock(&r, equeue_vclock_tick, equeue_vclock_advance, &rclock);
+
+    int replayed = 0;
+    struct indirect *p = 0;
+    for (int i = 1; i < 8; i++) {
+        const struct equeue_record *x = &rec.records[i];
+        int diff = (int)(x->tick - rclock.tick);
+        if (diff > 0) {
+            equeue_dispatch(&r, diff);
+        }
+
+        if (x->op == EQUEUE_RECORD_ALLOC) {
+            p = equeue_alloc_expire(&r, x->arg, x->period);
+            test_assert(p);
+            p->touched = &replayed;
+        } else if (x->op == EQUEUE_RECORD_REPOST) {
+            equeue_repost(&r, indirect_func, p, x->arg);
+        } else if (x->op == EQUEUE_RECORD_DISPATCH) {
+            equeue_dispatch(&r, 0);
+        } else if (x->op == EQUEUE_RECORD_DEALLOC) {
+            equeue_release(&r, p);
+        }
+    }
+    test_assert(replayed == 2);
+
+    struct equeue_stats stats;
+    equeue_stats(&r, &stats);
+    test_assert(stats.pending == 0);
+
+    equeue_destroy(&r);
+    equeue_destroy(&q);
+}
+
+void stats_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct equeue_stats stats;
+    equeue_stats(&q, &stats);
+    test_assert(stats.posted == 0);
+    test_assert(stats.pending == 0);
+    test_assert(stats.slab_used == 0);
+    test_assert(stats.free_bytes == 0);
+
+    int touched = 0;
+    int id1 = equeue_call(&q, simple_func, &touched);
+    int id2 = equeue_call_in(&q, 5, simple_func, &touched);
+    int id3 = equeue_call_every(&q, 1, simple_func, &touched);
+    int id4 = equeue_call_in(&q, 100, simple_func, &touched);
+    test_assert(id1 && id2 && id3 && id4);
+    equeue_cancel(&q, id4);
+
+    equeue_stats(&q, &stats);
+    test_assert(stats.posted == 4);
+    test_assert(stats.cancelled == 1);
+    test_assert(stats.pending == 3);
+    test_assert(stats.peak_pending == 4);
+    test_assert(stats.slab_used > 0);
+    test_assert(stats.free_bytes > 0);
+    test_assert(stats.largest_free == stats.free_bytes);
+
+    equeue_dispatch(&q, 10);
+    equeue_cancel(&q, id3);
+
+    equeue_stats(&q, &stats);
+    test_assert(stats.dispatched == touched);
+    test_assert(stats.dispatched >= 2 + 5);
+    test_assert(stats.cancelled == 2);
+    test_assert(stats.pending == 0);
+    test_assert(stats.peak_pending == 4);
+    test_assert(stats.passes > 0);
+
+    size_t used = stats.slab_used;
+    while (equeue_alloc(&q, 8));
+    equeue_stats(&q, &stats);
+    test_assert(stats.alloc_failures == 1);
+    test_assert(stats.slab_used > used);
+    test_assert(stats.free_bytes == 0);
+
+    equeue_destroy(&q);
+}
+
+struct hook_slow {
+    volatile int inside;
+    volatile int calls;
+};
+
+void hook_slow_func(void *p, const struct equeue_dispatch_info *info) {
+    struct hook_slow *h = (struct hook_slow *)p;
+    h->inside = 1;
+    usleep(1000);
+    h->calls++;
+    h->inside = 0;
+}
+
+struct hook_pair {
+    volatile int pre;
+    volatile int post;
+};
+
+void hook_pair_pre(void *p, const struct equeue_dispatch_info *info) {
+    ((struct hook_pair *)p)->pre++;
+}
+
+void hook_pair_post(void *p, const struct equeue_dispatch_info *info) {
+    ((struct hook_pair *)p)->post++;
+}
+
+void hook_sleep_func(void *p) {
+    usleep(500);
+}
+
+void hook_thread_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    int touched = 0;
+    equeue_call_every(&q, 1, simple_func, &touched);
+    equeue_call_every(&q, 1, hook_sleep_func, 0);
+
+    pthread_t thread;
+    err = pthread_create(&thread, 0, multithread_thread, &q);
+    test_assert(!err);
+
+    // once equeue_unhook returns, the hook is no longer being called, and
+    // hooks registered during a callback see both or neither of its pre
+    // and post
+    struct hook_slow slow = {0, 0};
+    struct equeue_hook h = {hook_slow_func, hook_slow_func, &slow};
+    struct hook_pair pair = {0, 0};
+    struct equeue_hook hp = {hook_pair_pre, hook_pair_post, &pair};
+    for (int i = 0; i < 20; i++) {
+        equeue_hook(&q, &hp);
+        equeue_hook(&q, &h);
+        usleep(2000);
+        equeue_unhook(&q, &h);
+        test_assert(!slow.inside);
+        int calls = slow.calls;
+        usleep(2000);
+        test_assert(slow.calls == calls);
+        equeue_unhook(&q, &hp);
+        test_assert(pair.pre == pair.post);
+    }
+    test_assert(slow.calls);
+    test_assert(pair.pre);
+
+    equeue_break(&q);
+    err = pthread_join(thread, 0);
+    test_assert(!err);
+
+    equeue_destroy(&q);
+}
+
+struct hook_count {
+    int pre;
+    int post;
+    int id;
+    unsigned target;
+    void *event;
+};
+
+void hook_pre_func(void *p, const struct equeue_dispatch_info *info) {
+    struct hook_count *c = (struct hook_count *)p;
+    test_assert(c->pre == c->post);
+    c->pre++;
+    c->id = info->id;
+    c->target = info->target;
+    c->event = info->event;
+    test_assert(info->cb);
+    test_assert((int)(info->start - info->target) >= 0);
+}
+
+void hook_post_func(void *p, const struct equeue_dispatch_info *info) {
+    struct hook_count *c = (struct hook_count *)p;
+    test_assert(!c->pre || c->id == info->id);
+    c->post++;
+}
+
+void hook_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct hook_count c1 = {0}, c2 = {0};
+    struct equeue_hook h1 = {hook_pre_func, hook_post_func, &c1};
+    struct equeue_hook h2 = {0, hook_post_func, &c2};
+    equeue_hook(&q, &h1);
+    equeue_hook(&q, &h2);
+
+    int touched = 0;
+    void *e = equeue_alloc(&q, sizeof(int));
+    test_assert(e);
+    equeue_event_delay(e, 10);
+    unsigned tick = equeue_tick();
+    int id = equeue_post(&q, pass_func, e);
+    equeue_call(&q, simple_func, &touched);
+
+    equeue_dispatch(&q, 20);
+    test_assert(touched == 1);
+    test_assert(c1.pre == 2 && c1.post == 2);
+    test_assert(c2.pre == 0 && c2.post == 2);
+    test_assert(c1.id == id);
+    test_assert(c1.event == e);
+    test_assert((int)(c1.target - tick) >= 10);
+
+    equeue_unhook(&q, &h1);
+    equeue_call(&q, simple_func, &touched);
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 2);
+    test_assert(c1.pre == 2 && c1.post == 2);
+    test_assert(c2.post == 3);
+
+    equeue_unhook(&q, &h2);
+    equeue_call(&q, simple_func, &touched);
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 3);
+    test_assert(c2.post == 3);
+
+    equeue_destroy(&q);
+}
+
+struct watchdog_report {
+    pthread_mutex_t lock;
+    void (*cb)(void *);
+    int overruns;
+    int finished;
+    int ms;
+};
+
+void watchdog_report_func(void *p, void (*cb)(void *), int ms, bool finished) {
+    struct watchdog_report *r = (struct watchdog_report *)p;
+    pthread_mutex_lock(&r->lock);
+    r->cb = cb;
+    if (finished) {
+        r->finished++;
+        r->ms = ms;
+    } else {
+        r->overruns++;
+    }
+    pthread_mutex_unlock(&r->lock);
+}
+
+void watchdog_slow_func(void *p) {
+    usleep(50*1000);
+}
+
+void watchdog_spin_func(void *p) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec)*1000000000
+            + (now.tv_nsec - start.tv_nsec) < 20000);
+    (*(int *)p)++;
+}
+
+void watchdog_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 64*1024);
+    test_assert(!err);
+
+    struct watchdog_report r = {PTHREAD_MUTEX_INITIALIZER};
+    equeue_watchdog_t w;
+    err = equeue_watchdog_create(&w, &q, 10, watchdog_report_func, &r);
+    test_assert(!err);
+
+    int touched = 0;
+    equeue_call(&q, simple_func, &touched);
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 1);
+    test_assert(r.overruns == 0 && r.finished == 0);
+
+    void *e = equeue_alloc(&q, 1);
+    test_assert(e);
+    equeue_post(&q, watchdog_slow_func, e);
+    equeue_dispatch(&q, 0);
+    test_assert(r.overruns == 1 && r.finished == 1);
+    test_assert(r.cb == watchdog_slow_func);
+    test_assert(r.ms >= 40);
+
+    equeue_call(&q, simple_func, &touched);
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 2);
+    test_assert(r.overruns == 1 && r.finished == 1);
+
+    // a burst of short callbacks does not wake the watchdog thread for
+    // each callback
+    for (int i = 0; i < 200; i++) {
+        test_assert(equeue_call(&q, watchdog_spin_func, &touched));
+    }
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    equeue_dispatch(&q, 0);
+    getrusage(RUSAGE_SELF, &after);
+    test_assert(touched == 202);
+    test_assert(after.ru_nvcsw + after.ru_nivcsw
+            - before.ru_nvcsw - before.ru_nivcsw < 50);
+    test_assert(r.overruns == 1 && r.finished == 1);
+
+    equeue_watchdog_destroy(&w);
+    equeue_call(&q, watchdog_slow_func, 0);
+    equeue_dispatch(&q, 0);
+    test_assert(r.overruns == 1 && r.finished == 1);
+
+    equeue_destroy(&q);
+}
+
+struct profiler_find {
+    void (*cb)(void *);
+    struct equeue_profile profile;
+};
+
+void profiler_find_func(void *p, const struct equeue_profile *profile) {
+    struct profiler_find *f = (struct profiler_find *)p;
+    if (profile->cb == f->cb) {
+        f->profile = *profile;
+    }
+}
+
+void profiler_spin_func(void *p) {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec)*1000
+            + (now.tv_nsec - start.tv_nsec)/1000000 < 5);
+}
+
+void profiler_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct equeue_profile profiles[2];
+    equeue_profiler_t p;
+    err = equeue_profiler_create(&p, &q, profiles, 2);
+    test_assert(!err);
+
+    for (int i = 0; i < 3; i++) {
+        void *e = equeue_alloc(&q, 1);
+        test_assert(e);
+        equeue_post(&q, profiler_spin_func, e);
+        e = equeue_alloc(&q, 1);
+        test_assert(e);
+        equeue_post(&q, pass_func, e);
+    }
+    equeue_dispatch(&q, 0);
+
+    struct profiler_find f = {profiler_spin_func};
+    equeue_profiler_dump(&p, profiler_find_func, &f);
+    test_assert(f.profile.count == 3);
+    test_assert(f.profile.wall_ns >= 15*1000000);
+    test_assert(f.profile.max_ns >= 5*1000000);
+    test_assert(f.profile.max_ns <= f.profile.wall_ns);
+    test_assert(f.profile.cpu_ns > 0);
+
+    f.cb = pass_func;
+    equeue_profiler_dump(&p, profiler_find_func, &f);
+    test_assert(f.profile.count == 3);
+    test_assert(p.dropped == 0);
+
+    int touched = 0;
+    equeue_call(&q, simple_func, &touched);
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 1);
+    test_assert(p.dropped == 1);
+
+    equeue_profiler_reset(&p);
+    f.profile.count = 0;
+    equeue_profiler_dump(&p, profiler_find_func, &f);
+    test_assert(f.profile.count == 0);
+
+    // equeue_call events are keyed on their function, not the trampoline
+    equeue_call(&q, simple_func, &touched);
+    equeue_call(&q, simple_func, &touched);
+    equeue_call_in(&q, 0, pass_func, 0);
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 3);
+    test_assert(p.dropped == 0);
+
+    f.cb = simple_func;
+    equeue_profiler_dump(&p, profiler_find_func, &f);
+    test_assert(f.profile.count == 2);
+    f.cb = pass_func;
+    equeue_profiler_dump(&p, profiler_find_func, &f);
+    test_assert(f.profile.count == 1);
+
+    equeue_profiler_destroy(&p);
+    equeue_destroy(&q);
+}
+
+void mem_info_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct equeue_mem_info info;
+    unsigned n = equeue_mem_info(&q, &info, 0, 0);
+    test_assert(n == 0);
+    test_assert(info.size == 2048);
+    test_assert(info.slab_used == 0 && info.slab_free == 2048);
+    test_assert(info.free_chunks == 0 && info.fragmentation == 0);
+
+    void *es[6];
+    for (int i = 0; i < 6; i++) {
+        es[i] = equeue_alloc(&q, i < 3 ? 4 : 100);
+        test_assert(es[i]);
+    }
+
+    // free every other event so they can't be merged
+    equeue_dealloc(&q, es[0]);
+    equeue_dealloc(&q, es[2]);
+    equeue_dealloc(&q, es[4]);
+
+    struct equeue_mem_chunk chunks[4];
+    n = equeue_mem_info(&q, &info, chunks, 4);
+    test_assert(n == 2);
+    test_assert(info.free_sizes == 2);
+    test_assert(info.free_chunks == 3);
+    test_assert(chunks[0].size < chunks[1].size);
+    test_assert(chunks[0].count == 2 && chunks[1].count == 1);
+    test_assert(info.largest_free == chunks[1].size);
+    test_assert(info.free_bytes == 2*chunks[0].size + chunks[1].size);
+    test_assert(info.slab_used + info.slab_free == info.size);
+    test_assert(info.requests[0] == 3);
+    test_assert(info.requests[4] == 3);
+
+    n = equeue_mem_info(&q, &info, chunks, 1);
+    test_assert(n == 1 && info.free_sizes == 2);
+
+    // exhaust the slab, leaving only fragmented events
+    while (equeue_alloc(&q, 200));
+    n = equeue_mem_info(&q, &info, 0, 0);
+    test_assert(info.fragmentation > 0);
+    test_assert(info.requests[5] > 0);
+
+    equeue_destroy(&q);
+}
+
+void exporter_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    equeue_exporter_t x;
+    err = equeue_exporter_create(&x);
+    test_assert(!err);
+
+    struct equeue_export entry;
+    equeue_exporter_add(&x, &entry, &q, "test");
+
+    int touched = 0;
+    equeue_call(&q, simple_func, &touched);
+    equeue_call(&q, simple_func, &touched);
+    equeue_call_in(&q, 100, simple_func, &touched);
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 2);
+
+    char buffer[4096];
+    int len = equeue_exporter_format(&x, buffer, sizeof(buffer));
+    test_assert(len > 0 && len < (int)sizeof(buffer));
+    test_assert(strlen(buffer) == (size_t)len);
+    test_assert(strstr(buffer,
+            "equeue_events_posted_total{queue=\"test\"} 3\n"));
+    test_assert(strstr(buffer,
+            "equeue_events_dispatched_total{queue=\"test\"} 2\n"));
+    test_assert(strstr(buffer,
+            "equeue_events_pending{queue=\"test\"} 1\n"));
+
+    // size_t statistics are read at their own width
+    struct equeue_stats stats;
+    equeue_stats(&q, &stats);
+    char slab[64];
+    snprintf(slab, sizeof(slab),
+            "equeue_slab_used_bytes{queue=\"test\"} %zu\n", stats.slab_used);
+    test_assert(stats.slab_used && strstr(buffer, slab));
+    test_assert(strstr(buffer, "equeue_dispatch_lag_milliseconds_bucket"
+            "{queue=\"test\",le=\"+Inf\"} 2\n"));
+    test_assert(strstr(buffer, "equeue_dispatch_lag_milliseconds_count"
+            "{queue=\"test\"} 2\n"));
+
+    // truncated formatting still reports the full length
+    char small[16];
+    test_assert(equeue_exporter_format(&x, small, sizeof(small)) == len);
+    test_assert(strlen(small) == sizeof(small)-1);
+
+    char path[] = "/tmp/equeue_exporter_XXXXXX";
+    int fd = mkstemp(path);
+    test_assert(fd >= 0);
+    close(fd);
+
+    err = equeue_exporter_write(&x, path);
+    test_assert(!err);
+    FILE *f = fopen(path, "r");
+    test_assert(f);
+    char file[4096];
+    size_t flen = fread(file, 1, sizeof(file), f);
+    fclose(f);
+    test_assert(flen == (size_t)len);
+    test_assert(memcmp(file, buffer, len) == 0);
+    unlink(path);
+
+    // scrape over a unix socket
+    err = equeue_exporter_listen(&x, path);
+    test_assert(!err);
+
+    struct sockaddr_un addr = {AF_UNIX};
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    test_assert(fd >= 0);
+    err = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    test_assert(!err);
+
+    const char *request = "GET /metrics HTTP/1.0\r\n\r\n";
+    test_assert(write(fd, request, strlen(request)) > 0);
+
+    char response[8192];
+    size_t rlen = 0;
+    ssize_t res;
+    while ((res = read(fd, response + rlen,
+            sizeof(response)-1 - rlen)) > 0) {
+        rlen += res;
+    }
+    response[rlen] = '\0';
+    close(fd);
+
+    test_assert(strncmp(response, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    test_assert(strstr(response,
+            "equeue_events_dispatched_total{queue=\"test\"} 2\n"));
+
+    // a client that sends nothing only stalls scrapes until it times out
+    int silent = socket(AF_UNIX, SOCK_STREAM, 0);
+    test_assert(silent >= 0);
+    err = connect(silent, (struct sockaddr *)&addr, sizeof(addr));
+    test_assert(!err);
+
+    unsigned start = equeue_tick();
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    test_assert(fd >= 0);
+    err = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+    test_assert(!err);
+    test_assert(write(fd, request, strlen(request)) > 0);
+    rlen = 0;
+    while ((res = read(fd, response + rlen,
+            sizeof(response)-1 - rlen)) > 0) {
+        rlen += res;
+    }
+    response[rlen] = '\0';
+    close(fd);
+    close(silent);
+    test_assert(strncmp(response, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    test_assert(equeue_tick() - start < EQUEUE_EXPORT_TIMEOUT + 500);
+
+    // destroying the exporter interrupts a stalled client
+    silent = socket(AF_UNIX, SOCK_STREAM, 0);
+    test_assert(silent >= 0);
+    err = connect(silent, (struct sockaddr *)&addr, sizeof(addr));
+    test_assert(!err);
+    usleep(10000);
+
+    start = equeue_tick();
+    equeue_exporter_destroy(&x);
+    test_assert(equeue_tick() - start < EQUEUE_EXPORT_TIMEOUT / 2);
+    test_assert(access(path, F_OK) != 0);
+    close(silent);
+
+    equeue_dispatch(&q, 0);
+    equeue_destroy(&q);
+}
+
+struct snapshot_churn {
+    equeue_t *q;
+    volatile bool done;
+};
+
+void *snapshot_churn_thread(void *p) {
+    struct snapshot_churn *c = (struct snapshot_churn *)p;
+    int i = 0;
+    while (!c->done) {
+        int id = equeue_call_in(c->q, 1000 + i%7, pass_func, 0);
+        equeue_cancel(c->q, id);
+        i++;
+    }
+    return 0;
+}
+
+void snapshot_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 64*EQUEUE_EVENT_SIZE);
+    test_assert(!err);
+
+    struct equeue_snapshot events[64];
+    test_assert(equeue_snapshot(&q, events, 64) == 0);
+
+    // several slots with several siblings, more than a chunk
+    int ids[40];
+    for (int i = 0; i < 40; i++) {
+        void *e = equeue_alloc(&q, 4 + i);
+        test_assert(e);
+        equeue_event_delay(e, 1000 + i%5);
+        equeue_event_period(e, i == 0 ? 10 : -1);
+        ids[i] = equeue_post(&q, pass_func, e);
+        test_assert(ids[i]);
+    }
+
+    unsigned n = equeue_snapshot(&q, events, 64);
+    test_assert(n == 40);
+    for (unsigned i = 0; i < n; i++) {
+        test_assert(events[i].cb == pass_func);
+        if (i > 0) {
+            test_assert((int)(events[i].target - events[i-1].target) >= 0);
+        }
+
+        int found = -1;
+        for (int j = 0; j < 40; j++) {
+            if (ids[j] == events[i].id) {
+                found = j;
+            }
+        }
+        test_assert(found >= 0);
+        test_assert(events[i].size >= (size_t)(4 + found));
+        test_assert(events[i].period == (found == 0 ? 10 : -1));
+    }
+
+    test_assert(equeue_snapshot(&q, events, 10) == 10);
+
+    // stable events are reported exactly once despite concurrent changes
+    struct snapshot_churn c = {&q, false};
+    pthread_t thread;
+    err = pthread_create(&thread, 0, snapshot_churn_thread, &c);
+    test_assert(!err);
+
+    for (int k = 0; k < 100; k++) {
+        n = equeue_snapshot(&q, events, 64);
+        for (int j = 0; j < 40; j++) {
+            int found = 0;
+            for (unsigned i = 0; i < n; i++) {
+                found += events[i].id == ids[j];
+            }
+            test_assert(found == 1);
+        }
+    }
+
+    c.done = true;
+    pthread_join(thread, 0);
+
+    equeue_cancel(&q, ids[0]);
+    n = equeue_snapshot(&q, events, 64);
+    test_assert(n == 39);
+
+    equeue_destroy(&q);
+}
+
+struct alert_count {
+    int failures;
+    int highwater;
+    struct equeue_alert_info info;
+};
+
+void alert_func(void *p, const struct equeue_alert_info *info) {
+    struct alert_count *c = (struct alert_count *)p;
+    if (info->type == EQUEUE_ALERT_ALLOC_FAILURE) {
+        c->failures++;
+    } else {
+        c->highwater++;
+    }
+    c->info = *info;
+}
+
+void alert_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 1024);
+    test_assert(!err);
+
+    struct alert_count c = {0};
+    equeue_alert(&q, 512, alert_func, &c);
+
+    // usage crosses the high-water mark once
+    void *es[64];
+    int n = 0;
+    while (c.highwater == 0) {
+        es[n] = equeue_alloc(&q, 32);
+        test_assert(es[n]);
+        n++;
+    }
+    test_assert(c.failures == 0);
+    test_assert(c.info.type == EQUEUE_ALERT_HIGHWATER);
+    test_assert(c.info.size == 32);
+    test_assert(c.info.used >= 512);
+    test_assert(c.info.slab_used == c.info.used);
+    test_assert(c.info.slab_used + c.info.slab_free == 1024);
+
+    es[n] = equeue_alloc(&q, 32);
+    test_assert(es[n]);
+    n++;
+    test_assert(c.highwater == 1);
+
+    // failures include the requested size and usage
+    void *e = equeue_alloc(&q, 2048);
+    test_assert(!e);
+    test_assert(c.failures == 1);
+    test_assert(c.info.type == EQUEUE_ALERT_ALLOC_FAILURE);
+    test_assert(c.info.size == 2048);
+
+    // dropping below the mark rearms the alert
+    for (int i = 0; i < n; i++) {
+        equeue_dealloc(&q, es[i]);
+    }
+    for (int i = 0; i < n; i++) {
+        es[i] = equeue_alloc(&q, 32);
+        test_assert(es[i]);
+    }
+    test_assert(c.highwater == 2);
+    test_assert(c.info.free_bytes == c.info.slab_used - c.info.used);
+
+    equeue_alert(&q, 0, 0, 0);
+    e = equeue_alloc(&q, 2048);
+    test_assert(!e);
+    test_assert(c.failures == 1);
+
+    equeue_destroy(&q);
+}
+
+struct alloc_wait_free {
+    equeue_t *q;
+    void *e;
+};
+
+void *alloc_wait_free_thread(void *p) {
+    struct alloc_wait_free *f = (struct alloc_wait_free *)p;
+    usleep(20*1000);
+    equeue_dealloc(f->q, f->e);
+    return 0;
+}
+
+void *alloc_wait_dispatch_thread(void *p) {
+    equeue_dispatch((equeue_t *)p, -1);
+    return 0;
+}
+
+struct alloc_waiter {
+    equeue_t *q;
+    size_t size;
+    int ms;
+    void *e;
+    unsigned elapsed;
+};
+
+void *alloc_waiter_thread(void *p) {
+    struct alloc_waiter *w = (struct alloc_waiter *)p;
+    unsigned tick = equeue_tick();
+    w->e = equeue_alloc_wait(w->q, w->size, w->ms);
+    w->elapsed = equeue_tick() - tick;
+    return 0;
+}
+
+void alloc_wait_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 8*EQUEUE_EVENT_SIZE);
+    test_assert(!err);
+
+    void *es[8];
+    int n = 0;
+    while (n < 8 && (es[n] = equeue_alloc(&q, 2*sizeof(void*)))) {
+        n++;
+    }
+    test_assert(n > 0 && !equeue_alloc(&q, 2*sizeof(void*)));
+
+    struct equeue_stats stats;
+    equeue_stats(&q, &stats);
+    unsigned failures = stats.alloc_failures;
+
+    // times out without memory, counting a single failure
+    test_assert(!equeue_alloc_wait(&q, 2*sizeof(void*), 0));
+    unsigned tick = equeue_tick();
+    test_assert(!equeue_alloc_wait(&q, 2*sizeof(void*), 20));
+    test_assert(equeue_tick() - tick >= 15);
+    equeue_stats(&q, &stats);
+    test_assert(stats.alloc_failures == failures + 2);
+
+    // wakes up once memory is freed
+    struct alloc_wait_free f = {&q, es[0]};
+    pthread_t thread;
+    err = pthread_create(&thread, 0, alloc_wait_free_thread, &f);
+    test_assert(!err);
+
+    tick = equeue_tick();
+    es[0] = equeue_alloc_wait(&q, 2*sizeof(void*), 1000);
+    test_assert(es[0]);
+    test_assert(equeue_tick() - tick < 500);
+    pthread_join(thread, 0);
+
+    for (int i = 0; i < n; i++) {
+        equeue_dealloc(&q, es[i]);
+    }
+
+    // producers are throttled by a slower dispatch loop
+    err = pthread_create(&thread, 0, alloc_wait_dispatch_thread, &q);
+    test_assert(!err);
+
+    for (int i = 0; i < 1000; i++) {
+        void *e = equeue_alloc_wait(&q, 2*sizeof(void*), -1);
+        test_assert(e);
+        equeue_post(&q, pass_func, e);
+    }
+
+    usleep(50*1000);
+    equeue_break(&q);
+    pthread_join(thread, 0);
+    equeue_stats(&q, &stats);
+    test_assert(stats.dispatched == 1000);
+
+    equeue_destroy(&q);
+}
+
+void alloc_wait_mixed_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 8*EQUEUE_EVENT_SIZE);
+    test_assert(!err);
+
+    void *es[8];
+    int n = 0;
+    while (n < 8 && (es[n] = equeue_alloc(&q, 2*sizeof(void*)))) {
+        n++;
+    }
+    test_assert(n > 0 && !equeue_alloc(&q, 2*sizeof(void*)));
+
+    // a waiter too large for the freed chunk is woken first, and must
+    // pass the wakeup on to a smaller waiter that fits
+    struct alloc_waiter big = {&q, 4*EQUEUE_EVENT_SIZE, 300, 0, 0};
+    struct alloc_waiter small = {&q, 2*sizeof(void*), 1000, 0, 0};
+    pthread_t big_thread, small_thread;
+    err = pthread_create(&big_thread, 0, alloc_waiter_thread, &big);
+    test_assert(!err);
+    usleep(10*1000);
+    err = pthread_create(&small_thread, 0, alloc_waiter_thread, &small);
+    test_assert(!err);
+    usleep(10*1000);
+
+    equeue_dealloc(&q, es[0]);
+    pthread_join(small_thread, 0);
+    pthread_join(big_thread, 0);
+
+    test_assert(small.e);
+    test_assert(small.elapsed < 200);
+    test_assert(!big.e);
+    es[0] = small.e;
+
+    test_assert(q.memwaiters == 0);
+
+    for (int i = 0; i < n; i++) {
+        equeue_dealloc(&q, es[i]);
+    }
+
+    equeue_destroy(&q);
+}
+
+struct overload_event {
+    int *evicted;
+    int index;
+};
+
+void overload_dtor(void *p) {
+    struct overload_event *e = (struct overload_event *)p;
+    if (*e->evicted < 0) {
+        *e->evicted = e->index;
+    }
+}
+
+int overload_fill(equeue_t *q, int *evicted, const int *priorities) {
+    int n = 0;
+    struct overload_event *e;
+    while ((e = equeue_alloc(q, sizeof(struct overload_event)))) {
+        e->evicted = evicted;
+        e->index = n;
+        equeue_event_delay(e, 100 + 10*(n % 4));
+        equeue_event_dtor(e, overload_dtor);
+        if (priorities[n] >= 0) {
+            equeue_event_droppable(e, priorities[n]);
+        }
+        equeue_post(q, pass_func, e);
+        n++;
+    }
+    return n;
+}
+
+void overload_test(void) {
+    const int priorities[] = {-1, 5, 2, 7, 3, -1, 9, 2, 4, 6, 8, 1};
+    int evicted = -1;
+
+    // dropping new events by default
+    equeue_t q;
+    int err = equeue_create(&q, 8*EQUEUE_EVENT_SIZE);
+    test_assert(!err);
+    int n = overload_fill(&q, &evicted, priorities);
+    test_assert(n > 4 && n < 12);
+    test_assert(!equeue_alloc(&q, sizeof(struct overload_event)));
+    test_assert(evicted == -1);
+    equeue_destroy(&q);
+
+    // evicting the droppable event with the earliest target, oldest
+    // first within a slot
+    err = equeue_create(&q, 8*EQUEUE_EVENT_SIZE);
+    test_assert(!err);
+    n = overload_fill(&q, &evicted, priorities);
+    equeue_overload(&q, EQUEUE_OVERLOAD_EVICT_OLDEST);
+    evicted = -1;
+    void *e = equeue_alloc(&q, sizeof(struct overload_event));
+    test_assert(e);
+    test_assert(evicted == 4);
+
+    struct equeue_stats stats;
+    equeue_stats(&q, &stats);
+    test_assert(stats.evicted == 1);
+    test_assert(stats.pending == (unsigned)n-1);
+    test_assert(stats.alloc_failures == 1);
+
+    // events too big to be satisfied by any droppable event still fail
+    evicted = -1;
+    test_assert(!equeue_alloc(&q, 4*EQUEUE_EVENT_SIZE));
+    test_assert(evicted == -1);
+    equeue_dealloc(&q, e);
+    equeue_destroy(&q);
+
+    // evicting the lowest priority
+    err = equeue_create(&q, 8*EQUEUE_EVENT_SIZE);
+    test_assert(!err);
+    n = overload_fill(&q, &evicted, priorities);
+    equeue_overload(&q, EQUEUE_OVERLOAD_EVICT_LOWEST);
+    evicted = -1;
+    e = equeue_alloc(&q, sizeof(struct overload_event));
+    test_assert(e);
+    test_assert(evicted == 2);
+    equeue_dealloc(&q, e);
+
+    // until only undroppable events remain
+    int count = 0;
+    while ((e = equeue_alloc(&q, sizeof(struct overload_event)))) {
+        equeue_post(&q, pass_func, e);
+        count++;
+    }
+    test_assert(count == 6);
+    equeue_stats(&q, &stats);
+    test_assert(stats.evicted == 6);
+    test_assert(stats.pending == (unsigned)n);
+
+    equeue_dispatch(&q, 200);
+    equeue_stats(&q, &stats);
+    test_assert(stats.dispatched == (unsigned)n);
+    equeue_destroy(&q);
+}
+
+int expire_dtors;
+
+void expire_sloth_func(void *p) {
+    (*(struct equeue_vclock **)p)->tick += 100;
+}
+
+void expire_touch_func(void *p) {
+    (**(int **)p)++;
+}
+
+void expire_dtor(void *p) {
+    expire_dtors++;
+}
+
+int expire_post(equeue_t *q, int *touched, int delay, int period, int expire) {
+    int **e = equeue_alloc_expire(q, sizeof(int *), expire);
+    test_assert(e);
+    *e = touched;
+    equeue_event_delay(e, delay);
+    equeue_event_period(e, period);
+    equeue_event_dtor(e, expire_dtor);
+    return equeue_post(q, expire_touch_func, e);
+}
+
+void expire_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct equeue_vclock clock = {0};
+    equeue_clock(&q, equeue_vclock_tick, equeue_vclock_advance, &clock);
+
+    // a slow callback delays the events behind it
+    struct equeue_vclock **e = equeue_alloc(&q, sizeof(struct equeue_vclock *));
+    test_assert(e);
+    *e = &clock;
+    equeue_post(&q, expire_sloth_func, e);
+
+    int fresh = 0, stale = 0, forever = 0;
+    expire_dtors = 0;
+    expire_post(&q, &fresh, 0, -1, 200);
+    expire_post(&q, &stale, 0, -1, 50);
+    expire_post(&q, &forever, 0, -1, -1);
+    equeue_dispatch(&q, 0);
+
+    test_assert(fresh == 1 && stale == 0 && forever == 1);
+    test_assert(expire_dtors == 3);
+
+    struct equeue_stats stats;
+    equeue_stats(&q, &stats);
+    test_assert(stats.expired == 1);
+    test_assert(stats.dispatched == 3);
+    test_assert(stats.pending == 0);
+
+    // the window is stored past the event's data
+    int **full = equeue_alloc_expire(&q, 3*sizeof(int *), 1000);
+    test_assert(full);
+    memset(full, 0xff, 3*sizeof(int *));
+    full[0] = &fresh;
+    equeue_post(&q, expire_touch_func, full);
+    equeue_dispatch(&q, 0);
+    test_assert(fresh == 2);
+
+    // periodic events only skip stale repetitions
+    int periodic = 0;
+    int id = expire_post(&q, &periodic, 10, 10, 5);
+    clock.tick += 20;
+    equeue_dispatch(&q, 0);
+    test_assert(periodic == 0);
+    equeue_stats(&q, &stats);
+    test_assert(stats.expired == 2);
+
+    equeue_dispatch(&q, 10);
+    test_assert(periodic == 2);
+    equeue_stats(&q, &stats);
+    test_assert(stats.expired == 2);
+
+    equeue_cancel(&q, id);
+    equeue_destroy(&q);
+}
+
+struct unique_repost {
+    equeue_t *q;
+    int *token;
+    int touched;
+};
+
+void unique_repost_func(void *p) {
+    struct unique_repost *r = (struct unique_repost *)p;
+    r->touched++;
+    if (r->touched == 1) {
+        // no longer pending, so this is a new event
+        int id = equeue_call_unique(r->q, r->token, unique_repost_func, r);
+        test_assert(id);
+    }
+}
+
+void unique_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    int token = 0;
+    int touched = 0;
+    test_assert(!equeue_pending(&q, token));
+
+    int id1 = equeue_call_unique(&q, &token, simple_func, &touched);
+    test_assert(id1 && token == id1);
+    test_assert(equeue_pending(&q, id1));
+
+    // redundant posts collapse into the pending event without allocating
+    struct equeue_stats stats;
+    struct equeue_mem_info info;
+    equeue_mem_info(&q, &info, 0, 0);
+    size_t used = info.slab_used;
+    for (int i = 0; i < 100; i++) {
+        test_assert(equeue_call_unique(&q, &token, simple_func, &touched)
+                == id1);
+    }
+    equeue_mem_info(&q, &info, 0, 0);
+    test_assert(info.slab_used == used);
+
+    void *e = equeue_alloc(&q, sizeof(int));
+    test_assert(e);
+    test_assert(equeue_post_unique(&q, &token, pass_func, e) == id1);
+    equeue_stats(&q, &stats);
+    test_assert(stats.posted == 1);
+
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 1);
+    test_assert(!equeue_pending(&q, id1));
+
+    // once dispatched or cancelled, a new event is posted
+    int id2 = equeue_call_unique(&q, &token, simple_func, &touched);
+    test_assert(id2 && id2 != id1 && token == id2);
+    equeue_cancel(&q, id2);
+    test_assert(!equeue_pending(&q, id2));
+    int id3 = equeue_call_unique(&q, &token, simple_func, &touched);
+    test_assert(id3 && id3 != id2);
+    equeue_dispatch(&q, 0);
+    test_assert(touched == 2);
+
+    // events being dispatched are no longer pending
+    struct unique_repost r = {&q, &token, 0};
+    test_assert(equeue_call_unique(&q, &token, unique_repost_func, &r));
+    equeue_dispatch(&q, 0);
+    test_assert(r.touched == 1);
+    test_assert(equeue_pending(&q, token));
+    equeue_dispatch(&q, 0);
+    test_assert(r.touched == 2);
+
+    equeue_destroy(&q);
+}
+
+struct repost {
+    equeue_t *q;
+    int touched;
+    int again;
+};
+
+void repost_func(void *p) {
+    struct repost *r = (struct repost *)p;
+    r->touched++;
+    if (r->again) {
+        r->again--;
+        test_assert(equeue_repost(r->q, repost_func, r, 10));
+    }
+}
+
+void repost_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct equeue_vclock clock = {0};
+    equeue_clock(&q, equeue_vclock_tick, equeue_vclock_advance, &clock);
+
+    struct repost *r = equeue_alloc(&q, sizeof(struct repost));
+    test_assert(r);
+    r->q = &q;
+    r->touched = 0;
+    r->again = 0;
+
+    // reposting a pending event pushes it back without allocating
+    struct equeue_mem_info info;
+    equeue_mem_info(&q, &info, 0, 0);
+    size_t used = info.slab_used;
+    size_t free_bytes = info.free_bytes;
+
+    int id1 = equeue_repost(&q, repost_func, r, 100);
+    test_assert(id1 && equeue_pending(&q, id1));
+    equeue_dispatch(&q, 50);
+    int id2 = equeue_repost(&q, repost_func, r, 100);
+    test_assert(id2 && id2 != id1);
+    test_assert(!equeue_pending(&q, id1) && equeue_pending(&q, id2));
+    equeue_cancel(&q, id1);
+    test_assert(equeue_pending(&q, id2));
+
+    equeue_dispatch(&q, 99);
+    test_assert(r->touched == 0);
+    equeue_dispatch(&q, 1);
+    test_assert(r->touched == 1);
+    test_assert(!equeue_pending(&q, id2));
+
+    struct equeue_stats stats;
+    equeue_stats(&q, &stats);
+    test_assert(stats.posted == 1 && stats.pending == 0);
+
+    // the event outlives dispatch and can be reposted
+    int id3 = equeue_repost(&q, repost_func, r, 0);
+    test_assert(id3 && id3 != id2);
+    equeue_dispatch(&q, 0);
+    test_assert(r->touched == 2);
+
+    // cancelled events stay allocated for reposting
+    int id4 = equeue_repost(&q, repost_func, r, 10);
+    equeue_cancel(&q, id4);
+    test_assert(!equeue_pending(&q, id4));
+    equeue_dispatch(&q, 20);
+    test_assert(r->touched == 2);
+    test_assert(equeue_repost(&q, repost_func, r, 10));
+    equeue_dispatch(&q, 10);
+    test_assert(r->touched == 3);
+
+    // reposting while dispatching schedules the event after the callback
+    r->again = 2;
+    test_assert(equeue_repost(&q, repost_func, r, 0));
+    equeue_dispatch(&q, 0);
+    test_assert(r->touched == 4);
+    equeue_dispatch(&q, 10);
+    test_assert(r->touched == 5);
+    equeue_dispatch(&q, 10);
+    test_assert(r->touched == 6);
+    equeue_dispatch(&q, 10);
+    test_assert(r->touched == 6);
+
+    equeue_mem_info(&q, &info, 0, 0);
+    test_assert(info.slab_used == used && info.free_bytes == free_bytes);
+    equeue_stats(&q, &stats);
+    test_assert(stats.pending == 0);
+
+    equeue_dealloc(&q, r);
+    equeue_destroy(&q);
+}
+
+struct release {
+    equeue_t *q;
+    int touched;
+    int *freed;
+};
+
+void release_dtor(void *p) {
+    struct release *r = (struct release *)p;
+    (*r->freed)++;
+}
+
+void release_func(void *p) {
+    struct release *r = (struct release *)p;
+    r->touched++;
+
+    // a repost is dropped by the release, and the event stays valid
+    // until the callback returns
+    test_assert(equeue_repost(r->q, release_func, r, 0));
+    equeue_release(r->q, r);
+    test_assert(*r->freed == 0);
+    r->touched++;
+}
+
+void release_test(void) {
+    equeue_t q;
+    int err = equeue_create(&q, 2048);
+    test_assert(!err);
+
+    struct equeue_vclock clock = {0};
+    equeue_clock(&q, equeue_vclock_tick, equeue_vclock_advance, &clock);
+
+    struct recording rec = {.count = 0};
+    equeue_recorder(&q, record_func, &rec);
+
+    struct equeue_mem_info info;
+    equeue_mem_info(&q, &info, 0, 0);
+    size_t used = info.slab_used - info.free_bytes;
+    int freed = 0;
+
+    // releasing a pending event cancels and frees it
+    struct release *r = equeue_alloc(&q, sizeof(struct release));
+    test_assert(r);
+    r->q = &q;
+    r->touched = 0;
+    r->freed = &freed;
+    equeue_event_dtor(r, release_dtor);
+    int id = equeue_repost(&q, release_func, r, 10);
+    test_assert(id && equeue_pending(&q, id));
+    test_assert(rec.records[2].op == EQUEUE_RECORD_REPOST);
+    test_assert(rec.records[2].id == id && rec.records[2].arg == 10);
+    equeue_release(&q, r);
+    test_assert(!equeue_pending(&q, id));
+    test_assert(freed == 1);
+    equeue_dispatch(&q, 20);
+
+    struct equeue_stats stats;
+    equeue_stats(&q, &stats);
+    test_assert(stats.posted == 1 && stats.cancelled == 1);
+    test_assert(stats.pending == 0);
+
+    // releasing an idle event frees it immediately
+    r = equeue_alloc(&q, sizeof(struct release));
+    test_assert(r);
+    r->q = &q;
+    r->touched = 0;
+    r->freed = &freed;
+    equeue_event_dtor(r, release_dtor);
+    equeue_release(&q, r);
+    test_assert(freed == 2);
+
+    // releasing during dispatch frees the event once the callback returns
+    freed = 0;
+    r = equeue_alloc(&q, sizeof(struct release));
+    test_assert(r);
+    r->q = &q;
+    r->touched = 0;
+    r->freed = &freed;
+    equeue_event_dtor(r, release_dtor);
+    test_assert(equeue_repost(&q, release_func, r, 0));
+    equeue_dispatch(&q, 0);
+    test_assert(freed == 1);
+    equeue_dispatch(&q, 10);
+    test_assert(freed == 1);
+
+    equeue_stats(&q, &stats);
+    test_assert(stats.dispatched == 1 && stats.pending == 0);
+    equeue_mem_info(&q, &info, 0, 0);
+    test_assert(info.slab_used - info.free_bytes == used);
+
+    equeue_recorder(&q, 0, 0);
+    equeue_destroy(&q);
+}
+
 void chain_test(void) {
     equeue_t q1;
     int err = equeue_create(&q1, 2048);
@@ -689,12 +2203,33 @@ int main() {
     test_run(cancel_test, 20);
     test_run(cancel_inflight_test);
     test_run(cancel_unnecessarily_test);
+    test_run(cancel_sibling_test);
     test_run(loop_protect_test);
     test_run(break_test);
     test_run(period_test);
     test_run(nested_test);
     test_run(sloth_test);
     test_run(background_test);
+    test_run(vclock_test);
+    test_run(recorder_test);
+    test_run(recorder_thread_test);
+    test_run(recorder_repost_test);
+    test_run(stats_test);
+    test_run(mem_info_test);
+    test_run(alert_test);
+    test_run(alloc_wait_test);
+    test_run(alloc_wait_mixed_test);
+    test_run(overload_test);
+    test_run(expire_test);
+    test_run(unique_test);
+    test_run(repost_test);
+    test_run(release_test);
+    test_run(snapshot_test);
+    test_run(hook_test);
+    test_run(hook_thread_test);
+    test_run(watchdog_test);
+    test_run(profiler_test);
+    test_run(exporter_test);
     test_run(chain_test);
     test_run(unchain_test);
     test_run(multithread_test);
@@ -0,0 +1,274 @@
+/*
+ * Event trace conversion for the events library
+ *
+ * Converts a ring of trace records captured with equeue_trace into Chrome
+ * trace JSON, which can be loaded into chrome://tracing or Perfetto to see
+ * callback durations, queueing delay and dispatcher idle time on a
+ * timeline.
+ *
+ * A trace file is a small header followed by the raw ring:
+ *
+ *   uint32_t magic  - EQUEUE_TRACE_MAGIC
+ *   uint32_t count  - number of records in the ring
+ *   uint32_t head   - records written, as returned by equeue_trace
+ *   struct equeue_trace_record records[count]
+ *
+ * With -r, a synthetic workload is traced and written in this format
+ * instead, as an example of capturing a trace.
+ *
+ * Must be compiled with EQUEUE_TRACE.
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#include "equeue.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+
+// Trace configuration
+#define TRACE_MAGIC 0x65717472
+#define TRACE_RECORDS (1 << 16)
+#define TRACE_DURATION 200
+
+static uint32_t trace_random(uint32_t *seed) {
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 8;
+}
+
+
+// Capturing a synthetic workload
+static void trace_func(void *p) {
+    // a bit of work so callbacks have visible durations
+    volatile uint32_t x = *(uint32_t *)p;
+    for (uint32_t i = 0; i < 1000 + x % 20000; i++) {
+        x = x * 1103515245 + 12345;
+    }
+}
+
+static void *trace_dispatcher(void *p) {
+    equeue_dispatch((equeue_t *)p, -1);
+    return 0;
+}
+
+static int trace_record(const char *path, int ms) {
+    static struct equeue_trace_record records[TRACE_RECORDS];
+
+    equeue_t q;
+    equeue_create(&q, 1024*EQUEUE_EVENT_SIZE);
+    equeue_trace(&q, records, TRACE_RECORDS);
+
+    pthread_t thread;
+    pthread_create(&thread, 0, trace_dispatcher, &q);
+
+    // bursts of immediate and delayed events, some of which are cancelled
+    uint32_t seed = 1;
+    for (int i = 0; i < ms; i++) {
+        int burst = trace_random(&seed) % 8;
+        for (int j = 0; j < burst; j++) {
+            uint32_t *e = equeue_alloc(&q, sizeof(uint32_t));
+            if (!e) {
+                continue;
+            }
+
+            *e = trace_random(&seed);
+            equeue_event_delay(e, trace_random(&seed) % 2 ? 0 :
+                    trace_random(&seed) % 20);
+            int id = equeue_post(&q, trace_func, e);
+
+            if (trace_random(&seed) % 8 == 0) {
+                equeue_cancel(&q, id);
+            }
+        }
+
+        usleep(1000);
+    }
+
+    usleep(50*1000);
+    equeue_break(&q);
+    pthread_join(thread, 0);
+    uint32_t head = equeue_trace(&q, 0, 0);
+    equeue_destroy(&q);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+
+    uint32_t header[3] = {TRACE_MAGIC, TRACE_RECORDS, head};
+    fwrite(header, sizeof(header), 1, f);
+    fwrite(records, sizeof(records), 1, f);
+    fclose(f);
+
+    fprintf(stderr, "traced %" PRIu32 " records to %s\n", head, path);
+    return 0;
+}
+
+
+// Conversion to Chrome trace JSON
+enum {
+    TRACE_TID_DISPATCH = 1,
+    TRACE_TID_POST = 2,
+};
+
+static void trace_event(const char *sep, const char *name, const char *ph,
+        int tid, double us, int id) {
+    printf("%s\n{\"name\": \"%s\", \"ph\": \"%s\", \"pid\": 1, \"tid\": %d, "
+            "\"ts\": %.3f", sep, name, ph, tid, us);
+
+    if (strcmp(ph, "i") == 0) {
+        printf(", \"s\": \"t\"");
+    } else if (strcmp(ph, "s") == 0 || strcmp(ph, "f") == 0) {
+        printf(", \"cat\": \"queue\", \"id\": %d%s", id,
+                strcmp(ph, "f") == 0 ? ", \"bp\": \"e\"" : "");
+    }
+
+    if (id) {
+        printf(", \"args\": {\"id\": %d}", id);
+    }
+    printf("}");
+}
+
+static int trace_convert(const char *path, double freq) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+
+    uint32_t header[3];
+    if (fread(header, sizeof(header), 1, f) != 1 ||
+            header[0] != TRACE_MAGIC || !header[1] ||
+            (header[1] & (header[1]-1))) {
+        fprintf(stderr, "%s: not a trace\n", path);
+        return 1;
+    }
+
+    uint32_t count = header[1];
+    uint32_t head = header[2];
+    struct equeue_trace_record *records = malloc(
+            count*sizeof(struct equeue_trace_record));
+    if (fread(records, sizeof(struct equeue_trace_record), count, f)
+            != count) {
+        fprintf(stderr, "%s: truncated trace\n", path);
+        return 1;
+    }
+    fclose(f);
+
+    // order the ring from its oldest record
+    uint32_t n = head < count ? head : count;
+    uint32_t first = head - n;
+    #define TRACE_AT(i) (&records[(first + (i)) & (count-1)])
+
+    // relate stamps to milliseconds using the ticks recorded on dequeue
+    if (!freq) {
+        struct equeue_trace_record *a = 0;
+        struct equeue_trace_record *b = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            struct equeue_trace_record *r = TRACE_AT(i);
+            if (r->op == EQUEUE_TRACE_DEQUEUE) {
+                a = a ? a : r;
+                b = r;
+            }
+        }
+
+        if (!a || (unsigned)b->id - (unsigned)a->id < 10) {
+            fprintf(stderr, "%s: too short to calibrate, "
+                    "pass stamps per us explicitly\n", path);
+            return 1;
+        }
+
+        freq = (double)(b->stamp - a->stamp)
+                / ((unsigned)b->id - (unsigned)a->id) / 1000;
+    }
+
+    uint64_t origin = n ? TRACE_AT(0)->stamp : 0;
+    const char *sep = "";
+
+    printf("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    printf("\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+            "\"tid\": %d, \"args\": {\"name\": \"dispatch\"}},",
+            TRACE_TID_DISPATCH);
+    printf("\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+            "\"tid\": %d, \"args\": {\"name\": \"post\"}}",
+            TRACE_TID_POST);
+    sep = ",";
+
+    // begin and end events must be balanced, so skip ends whose
+    // beginning was overwritten in the ring
+    int callbacks = 0;
+    int waits = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        struct equeue_trace_record *r = TRACE_AT(i);
+        double us = (double)(int64_t)(r->stamp - origin) / freq;
+
+        switch (r->op) {
+            case EQUEUE_TRACE_POST:
+                trace_event(sep, "post", "i", TRACE_TID_POST, us, r->id);
+                trace_event(sep, "queued", "s", TRACE_TID_POST, us, r->id);
+                break;
+
+            case EQUEUE_TRACE_CANCEL:
+                trace_event(sep, "cancel", "i", TRACE_TID_POST, us, r->id);
+                break;
+
+            case EQUEUE_TRACE_DEQUEUE:
+                trace_event(sep, "dequeue", "i", TRACE_TID_DISPATCH, us, 0);
+                break;
+
+            case EQUEUE_TRACE_START:
+                trace_event(sep, "queued", "f", TRACE_TID_DISPATCH,
+                        us, r->id);
+                trace_event(sep, "callback", "B", TRACE_TID_DISPATCH,
+                        us, r->id);
+                callbacks += 1;
+                break;
+
+            case EQUEUE_TRACE_END:
+                if (callbacks > 0) {
+                    trace_event(sep, "callback", "E", TRACE_TID_DISPATCH,
+                            us, r->id);
+                    callbacks -= 1;
+                }
+                break;
+
+            case EQUEUE_TRACE_WAIT:
+                trace_event(sep, "idle", "B", TRACE_TID_DISPATCH, us, 0);
+                waits += 1;
+                break;
+
+            case EQUEUE_TRACE_WAKE:
+                if (waits > 0) {
+                    trace_event(sep, "idle", "E", TRACE_TID_DISPATCH, us, 0);
+                    waits -= 1;
+                }
+                break;
+        }
+    }
+
+    printf("\n]}\n");
+    free(records);
+    return 0;
+}
+
+
+// Entry point
+int main(int argc, char **argv) {
+    if (argc > 2 && strcmp(argv[1], "-r") == 0) {
+        int ms = argc > 3 ? atoi(argv[3]) : TRACE_DURATION;
+        return trace_record(argv[2], ms);
+    } else if (argc > 1) {
+        double freq = argc > 2 ? atof(argv[2]) : 0;
+        return trace_convert(argv[1], freq);
+    }
+
+    fprintf(stderr, "usage: %s <trace> [stamps per us] > trace.json\n"
+            "       %s -r <trace> [ms]\n", argv[0], argv[0]);
+    return 2;
+}
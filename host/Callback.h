@@ -0,0 +1,169 @@
+/* events
+ * Copyright (c) 2006-2013 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef MBED_CALLBACK_H
+#define MBED_CALLBACK_H
+
+#include <cstring>
+#include <new>
+
+namespace mbed {
+
+/** Callback
+ *
+ *  Minimal host implementation of mbed's Callback class, providing only
+ *  what the events library needs to build without mbed OS. A callback
+ *  stores either a function pointer or an object with a member function,
+ *  the same as the mbed implementation.
+ */
+template <typename F>
+class Callback;
+
+/** Callback
+ *
+ *  Minimal host implementation of mbed's Callback class
+ */
+template <typename R, typename... Args>
+class Callback<R(Args...)> {
+public:
+    /** Create a Callback with a static function
+     *
+     *  @param func     Static function to attach
+     */
+    Callback(R (*func)(Args...) = 0) {
+        std::memset(&_func, 0, sizeof _func);
+        _obj = 0;
+        _thunk = func ? &Callback::function_thunk : 0;
+        _func._staticfunc = func;
+    }
+
+    /** Create a Callback with a member function
+     *
+     *  @param obj      Pointer to object to invoke member function on
+     *  @param method   Member function to attach
+     */
+    template <typename T>
+    Callback(T *obj, R (T::*method)(Args...)) {
+        generate(obj, method);
+    }
+
+    /** Create a Callback with a member function
+     *  @see Callback::Callback
+     */
+    template <typename T>
+    Callback(const T *obj, R (T::*method)(Args...) const) {
+        generate(obj, method);
+    }
+
+    /** Create a Callback with a member function
+     *  @see Callback::Callback
+     */
+    template <typename T>
+    Callback(volatile T *obj, R (T::*method)(Args...) volatile) {
+        generate(obj, method);
+    }
+
+    /** Create a Callback with a member function
+     *  @see Callback::Callback
+     */
+    template <typename T>
+    Callback(const volatile T *obj, R (T::*method)(Args...) const volatile) {
+        generate(obj, method);
+    }
+
+    /** Create a Callback with a static function and bound pointer
+     *
+     *  @param func     Static function to attach
+     *  @param arg      Pointer argument to function
+     */
+    template <typename T>
+    Callback(R (*func)(T*, Args...), T *arg) {
+        generate(arg, func);
+    }
+
+    /** Call the attached function
+     */
+    R call(Args... args) const {
+        return _thunk(_obj, &_func, args...);
+    }
+
+    /** Call the attached function
+     */
+    R operator()(Args... args) const {
+        return call(args...);
+    }
+
+    /** Test if function has been attached
+     */
+    operator bool() const {
+        return _thunk;
+    }
+
+    /** Static thunk for passing as C-style function
+     *
+     *  @param func     Callback to call passed as void pointer
+     */
+    static R thunk(void *func, Args... args) {
+        return static_cast<Callback*>(func)->call(args...);
+    }
+
+private:
+    // Stored as pointer to the largest member function type so any
+    // member function fits
+    struct _class;
+    union {
+        R (*_staticfunc)(Args...);
+        R (_class::*_methodfunc)(Args...);
+        char _storage[sizeof(R (_class::*)(Args...)) > sizeof(void (*)())
+                ? sizeof(R (_class::*)(Args...)) : sizeof(void (*)())];
+    } _func;
+
+    void *_obj;
+    R (*_thunk)(void *, const void *, Args...);
+
+    template <typename T, typename F>
+    void generate(T *obj, F func) {
+        struct local {
+            static R thunk(void *obj, const void *func, Args... args) {
+                T *o = static_cast<T*>(obj);
+                const F *f = static_cast<const F*>(func);
+                return method_call(o, *f, args...);
+            }
+        };
+
+        std::memset(&_func, 0, sizeof _func);
+        std::memcpy(&_func, &func, sizeof func);
+        _obj = const_cast<void*>(static_cast<const volatile void*>(obj));
+        _thunk = &local::thunk;
+    }
+
+    template <typename T, typename M>
+    static R method_call(T *obj, M method, Args... args) {
+        return (obj->*method)(args...);
+    }
+
+    template <typename T>
+    static R method_call(T *obj, R (*func)(T*, Args...), Args... args) {
+        return func(obj, args...);
+    }
+
+    static R function_thunk(void *, const void *func, Args... args) {
+        return (*static_cast<R (*const *)(Args...)>(func))(args...);
+    }
+};
+
+}
+
+#endif
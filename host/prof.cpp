@@ -0,0 +1,262 @@
+/*
+ * Profiling of the C++ layer of the events library
+ *
+ * Measures the overhead of the EventQueue and Event templates against
+ * the underlying equeue functions they are built on.
+ *
+ * Copyright (c) 2016 Christopher Haster
+ * Distributed under the MIT license
+ */
+#include "mbed_events.h"
+#include "equeue/tests/prof.h"
+
+
+// Various test functions
+void no_func(void *) {
+}
+
+void no_func0() {
+}
+
+void no_func1(int) {
+}
+
+void no_func2(int, int) {
+}
+
+void no_func3(int, int, int) {
+}
+
+void no_func4(int, int, int, int) {
+}
+
+void no_func5(int, int, int, int, int) {
+}
+
+struct no_obj {
+    void no_method() {}
+    void no_method1(int) {}
+};
+
+
+// Baselines on the underlying equeue
+void baseline_prof(void) {
+    prof_loop() {
+        prof_start();
+        __asm__ volatile ("");
+        prof_stop();
+    }
+}
+
+void equeue_call_prof(void) {
+    struct equeue q;
+    equeue_create(&q, EVENTS_EVENT_SIZE);
+
+    prof_loop() {
+        prof_start();
+        int id = equeue_call(&q, no_func, 0);
+        prof_stop();
+
+        equeue_cancel(&q, id);
+    }
+
+    equeue_destroy(&q);
+}
+
+void equeue_call_dispatch_prof(void) {
+    struct equeue q;
+    equeue_create(&q, EVENTS_EVENT_SIZE);
+
+    prof_loop() {
+        equeue_call(&q, no_func, 0);
+
+        prof_start();
+        equeue_dispatch(&q, 0);
+        prof_stop();
+    }
+
+    equeue_destroy(&q);
+}
+
+
+// EventQueue::call with bound arguments
+#define EVENTQUEUE_CALL_PROF(i, ...)                                        \
+void eventqueue_call##i##_prof(void) {                                      \
+    EventQueue q(EVENTS_EVENT_SIZE + 8*sizeof(int));                        \
+                                                                            \
+    prof_loop() {                                                           \
+        prof_start();                                                       \
+        int id = q.call(no_func##i,##__VA_ARGS__);                          \
+        prof_stop();                                                        \
+                                                                            \
+        q.cancel(id);                                                       \
+    }                                                                       \
+}
+
+EVENTQUEUE_CALL_PROF(0)
+EVENTQUEUE_CALL_PROF(1, 1)
+EVENTQUEUE_CALL_PROF(2, 1, 2)
+EVENTQUEUE_CALL_PROF(3, 1, 2, 3)
+EVENTQUEUE_CALL_PROF(4, 1, 2, 3, 4)
+EVENTQUEUE_CALL_PROF(5, 1, 2, 3, 4, 5)
+
+void eventqueue_call_method_prof(void) {
+    EventQueue q(EVENTS_EVENT_SIZE + 8*sizeof(int));
+    no_obj obj;
+
+    prof_loop() {
+        prof_start();
+        int id = q.call(&obj, &no_obj::no_method);
+        prof_stop();
+
+        q.cancel(id);
+    }
+}
+
+void eventqueue_call_method1_prof(void) {
+    EventQueue q(EVENTS_EVENT_SIZE + 8*sizeof(int));
+    no_obj obj;
+
+    prof_loop() {
+        prof_start();
+        int id = q.call(&obj, &no_obj::no_method1, 1);
+        prof_stop();
+
+        q.cancel(id);
+    }
+}
+
+void eventqueue_call0_dispatch_prof(void) {
+    EventQueue q(EVENTS_EVENT_SIZE + 8*sizeof(int));
+
+    prof_loop() {
+        q.call(no_func0);
+
+        prof_start();
+        q.dispatch(0);
+        prof_stop();
+    }
+}
+
+void eventqueue_call5_dispatch_prof(void) {
+    EventQueue q(EVENTS_EVENT_SIZE + 8*sizeof(int));
+
+    prof_loop() {
+        q.call(no_func5, 1, 2, 3, 4, 5);
+
+        prof_start();
+        q.dispatch(0);
+        prof_stop();
+    }
+}
+
+
+// Event<void(A0..A4)>::post
+#define EVENT_POST_PROF(i, type, ...)                                       \
+void event_post##i##_prof(void) {                                           \
+    EventQueue q(3*(EVENTS_EVENT_SIZE + 8*sizeof(int)));                    \
+    Event<type> e(&q, no_func##i);                                          \
+                                                                            \
+    prof_loop() {                                                           \
+        prof_start();                                                       \
+        int id = e.post(__VA_ARGS__);                                       \
+        prof_stop();                                                        \
+                                                                            \
+        q.cancel(id);                                                       \
+    }                                                                       \
+}
+
+EVENT_POST_PROF(0, void())
+EVENT_POST_PROF(1, void(int), 1)
+EVENT_POST_PROF(2, void(int, int), 1, 2)
+EVENT_POST_PROF(3, void(int, int, int), 1, 2, 3)
+EVENT_POST_PROF(4, void(int, int, int, int), 1, 2, 3, 4)
+EVENT_POST_PROF(5, void(int, int, int, int, int), 1, 2, 3, 4, 5)
+
+void event_post5_dispatch_prof(void) {
+    EventQueue q(3*(EVENTS_EVENT_SIZE + 8*sizeof(int)));
+    Event<void(int, int, int, int, int)> e(&q, no_func5);
+
+    prof_loop() {
+        e.post(1, 2, 3, 4, 5);
+
+        prof_start();
+        q.dispatch(0);
+        prof_stop();
+    }
+}
+
+
+// Event reference counting
+void event_create_prof(void) {
+    EventQueue q(3*(EVENTS_EVENT_SIZE + 8*sizeof(int)));
+
+    prof_loop() {
+        prof_start();
+        {
+            Event<void()> e(&q, no_func0);
+        }
+        prof_stop();
+    }
+}
+
+void event_copy_prof(void) {
+    EventQueue q(3*(EVENTS_EVENT_SIZE + 8*sizeof(int)));
+    Event<void()> e(&q, no_func0);
+
+    prof_loop() {
+        prof_start();
+        {
+            Event<void()> copy(e);
+        }
+        prof_stop();
+    }
+}
+
+void event_assign_prof(void) {
+    EventQueue q(3*(EVENTS_EVENT_SIZE + 8*sizeof(int)));
+    Event<void()> e(&q, no_func0);
+    Event<void()> copy(e);
+
+    prof_loop() {
+        prof_start();
+        copy = e;
+        prof_stop();
+    }
+}
+
+
+// Entry point
+int main() {
+    prof_begin();
+
+    prof_baseline(baseline_prof);
+
+    prof_measure(equeue_call_prof);
+    prof_measure(eventqueue_call0_prof);
+    prof_measure(eventqueue_call1_prof);
+    prof_measure(eventqueue_call2_prof);
+    prof_measure(eventqueue_call3_prof);
+    prof_measure(eventqueue_call4_prof);
+    prof_measure(eventqueue_call5_prof);
+    prof_measure(eventqueue_call_method_prof);
+    prof_measure(eventqueue_call_method1_prof);
+
+    prof_measure(event_post0_prof);
+    prof_measure(event_post1_prof);
+    prof_measure(event_post2_prof);
+    prof_measure(event_post3_prof);
+    prof_measure(event_post4_prof);
+    prof_measure(event_post5_prof);
+
+    prof_measure(equeue_call_dispatch_prof);
+    prof_measure(eventqueue_call0_dispatch_prof);
+    prof_measure(eventqueue_call5_dispatch_prof);
+    prof_measure(event_post5_dispatch_prof);
+
+    prof_measure(event_create_prof);
+    prof_measure(event_copy_prof);
+    prof_measure(event_assign_prof);
+
+    prof_end();
+}
@@ -24,6 +24,8 @@
 
 #include "EventQueue.h"
 #include "Event.h"
+#include "Debouncer.h"
+#include "Throttler.h"
 
 using namespace events;
 